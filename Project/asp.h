@@ -15,5 +15,8 @@ extern void pushRegsOnPSP();
 extern void popRegsOnPSP();
 
 extern uint32_t getR0();
+extern uint32_t getIPSR();
+extern uint32_t getCONTROL();
+extern uint32_t countLeadingZeros(uint32_t value);
 
 #endif
@@ -10,6 +10,9 @@
 	.def pushRegsOnPSP
 	.def popRegsOnPSP
 	.def getR0
+	.def getIPSR
+	.def getCONTROL
+	.def countLeadingZeros
 
 ;-----------------------------------------------------------------------------
 ; Register values and large immediate values
@@ -92,7 +95,17 @@ popRegsOnPSP:
 getR0:
 		BX  LR
 
+getIPSR:
+		MRS R0, IPSR		; Exception number, 0 in thread mode
 
+		BX  LR
+
+getCONTROL:
+		MRS R0, CONTROL		; bit 0 = TMPL (unprivileged thread)
 
+		BX  LR
 
+countLeadingZeros:
+		CLZ R0, R0			; 32 for 0
 
+		BX  LR
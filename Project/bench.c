@@ -0,0 +1,203 @@
+// Kernel benchmark
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Times the kernel primitives from a task, the way application code pays for them,
+// with the TIMER2 cycle count (LOG_TIME) since tasks can not read the DWT.
+// Preemption stays on, so max includes the SysTick and PendSV that land in a run.
+// Output, one line:
+//   {"bench":"rtos","version":1,"clock":40000000,"runs":1000,"results":[
+//    {"name":"yield","min":..,"avg":..,"max":..},...]}
+// all in cycles, timer is the cost of reading the time and is not subtracted
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "kernel.h"
+#include "uart0.h"
+#include "log.h"
+#include "fmt.h"
+#include "bench.h"
+
+#define BENCH_VERSION   1
+#define BENCH_TIME()    LOG_TIME()
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Before startRtos, the bench semaphores start empty
+void initBench(void)
+{
+    initSemaphore(BENCH_PING, 0);
+    initSemaphore(BENCH_PONG, 0);
+    initSemaphore(BENCH_GO, 0);
+}
+
+void benchStart(BENCH_RESULT *r, const char *name)
+{
+    r->name = name;
+    r->min = 0xFFFFFFFF;
+    r->max = 0;
+    r->sum = 0;
+}
+
+void benchAdd(BENCH_RESULT *r, uint32_t cycles)
+{
+    if(cycles < r->min)
+        r->min = cycles;
+    if(cycles > r->max)
+        r->max = cycles;
+    r->sum += cycles;
+}
+
+void putJsonUint(const char *key, uint32_t n)
+{
+    char str[12];
+
+    putsUart0(",\"");
+    putsUart0((char *)key);
+    putsUart0("\":");
+    fmtUint(str, n, 0, ' ');
+    putsUart0(str);
+}
+
+void putBenchResults(BENCH_RESULT r[], uint8_t count)
+{
+    char str[12];
+    uint8_t i;
+
+    putsUart0("{\"bench\":\"rtos\",\"version\":");
+    fmtUint(str, BENCH_VERSION, 0, ' ');
+    putsUart0(str);
+    putJsonUint("clock", 40000000);
+    putJsonUint("runs", BENCH_RUNS);
+    putsUart0(",\"results\":[");
+    for(i=0; i<count; i++) {
+        putsUart0(i ? ",{\"name\":\"" : "{\"name\":\"");
+        putsUart0((char *)r[i].name);
+        putsUart0("\"");
+        putJsonUint("min", r[i].min);
+        putJsonUint("avg", r[i].sum / BENCH_RUNS);
+        putJsonUint("max", r[i].max);
+        putsUart0("}");
+    }
+    putsUart0("]}\n");
+}
+
+// Answers every ping with a pong, a round trip is two switches and a post/wait each way
+void benchPong(void)
+{
+    while(true) {
+        wait(BENCH_PING);
+        post(BENCH_PONG);
+    }
+}
+
+// Same priority as the bench. Once let go it yields a bit more than BENCH_RUNS times
+// (spares in case a preemption reorders the two), so every bench yield in that run
+// switches here and back
+void benchYield(void)
+{
+    uint16_t i;
+
+    while(true) {
+        wait(BENCH_GO);
+        for(i=0; i<BENCH_RUNS + BENCH_RUNS/10; i++)
+            yield();
+    }
+}
+
+// The bench task, runs each primitive BENCH_RUNS times then prints the results
+void bench(void)
+{
+    BENCH_RESULT r[9];
+    uint32_t t;
+    uint16_t i;
+    uint8_t n = 0, h;
+
+    sleep(100);                                 // Let start up output drain
+
+    benchStart(&r[n], "timer");
+    for(i=0; i<BENCH_RUNS; i++) {
+        t = BENCH_TIME();
+        benchAdd(&r[n], BENCH_TIME() - t);
+    }
+    n++;
+
+    benchStart(&r[n], "yield");                 // Nothing else ready at this priority
+    for(i=0; i<BENCH_RUNS; i++) {
+        t = BENCH_TIME();
+        yield();
+        benchAdd(&r[n], BENCH_TIME() - t);
+    }
+    n++;
+
+    benchStart(&r[n], "yield_switch_pair");     // To benchYield and back
+    post(BENCH_GO);
+    for(i=0; i<BENCH_RUNS; i++) {
+        t = BENCH_TIME();
+        yield();
+        benchAdd(&r[n], BENCH_TIME() - t);
+    }
+    n++;
+
+    benchStart(&r[n], "sleep_1ms");
+    for(i=0; i<BENCH_RUNS; i++) {
+        t = BENCH_TIME();
+        sleep(1);
+        benchAdd(&r[n], BENCH_TIME() - t);
+    }
+    n++;
+
+    benchStart(&r[n], "mutex_lock_unlock");     // Uncontended
+    for(i=0; i<BENCH_RUNS; i++) {
+        t = BENCH_TIME();
+        lock(resource);
+        unlock(resource);
+        benchAdd(&r[n], BENCH_TIME() - t);
+    }
+    n++;
+
+    benchStart(&r[n], "sem_post_wait");         // Uncontended, only the bench waits on PONG
+    for(i=0; i<BENCH_RUNS; i++) {
+        t = BENCH_TIME();
+        post(BENCH_PONG);
+        wait(BENCH_PONG);
+        benchAdd(&r[n], BENCH_TIME() - t);
+    }
+    n++;
+
+    benchStart(&r[n], "sem_pingpong");          // Higher priority benchPong answers
+    for(i=0; i<BENCH_RUNS; i++) {
+        t = BENCH_TIME();
+        post(BENCH_PING);
+        wait(BENCH_PONG);
+        benchAdd(&r[n], BENCH_TIME() - t);
+    }
+    n++;
+
+    benchStart(&r[n], "heap_malloc_free");      // mallocFromHeap and freeTask through a handle
+    for(i=0; i<BENCH_RUNS; i++) {
+        t = BENCH_TIME();
+        h = _mallocHandle(BENCH_HEAP_SIZE);
+        _freeHandle(h);
+        benchAdd(&r[n], BENCH_TIME() - t);
+    }
+    n++;
+
+    putBenchResults(r, n);
+
+    while(true)
+        sleep(1000);
+}
@@ -0,0 +1,45 @@
+// Kernel benchmark
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+
+// 1 builds the benchmark firmware: rtos.c starts only Idle and the bench tasks, the
+// results go out on UART0 as one JSON line and the board then idles. 0 for the normal tasks
+#define BENCH           0
+#define BENCH_RUNS      1000                // timed iterations of each primitive
+#define BENCH_HEAP_SIZE 256                 // bytes per handle malloc/free
+
+// Semaphores nothing else uses when BENCH is 1 (the key and flash tasks are not started)
+#define BENCH_PING      keyPressed
+#define BENCH_PONG      keyReleased
+#define BENCH_GO        flashReq
+
+// Cycles of one primitive over BENCH_RUNS runs
+typedef struct _BENCH_RESULT {
+    const char *name;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} BENCH_RESULT;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initBench(void);
+void putJsonUint(const char *key, uint32_t n);
+void bench(void);
+void benchPong(void);
+void benchYield(void);
+
+#endif
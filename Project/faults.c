@@ -19,6 +19,7 @@
 #include "asp.h"
 #include "shell.h" 
 #include "kernel.h"
+#include "log.h"
 
 
 extern uint8_t taskCurrent;
@@ -47,17 +48,40 @@ void mpuFaultIsr(void)
     display("MSP:    0x", (uint32_t)MSP, 1, 8);
     display("mflags: 0x", mfault, 1, 8);
 
-    // Also, print the offending instruction and data addresses.
-    uint16_t instr = *( (uint32_t *)(*(PSP+6)));
     uint32_t memAdr = NVIC_MM_ADDR_R;
 
-    putsUart0("------------------\n");
-    display("ofsIns: 0x", instr, 1, 8);
-    display("memAdr: 0x", memAdr, 1, 8);
-    putsUart0("------------------\n");
-
-    // Display the process stack dump (xPSR, PC, LR, R0-3, R12.
-    stackDump(PSP);
+    // Access to the guard sub-region below the stack (or failed exception stacking into it) is a stack overflow.
+    // Checked first, nothing below may fault before it is reported
+    if(((mfault & NVIC_FAULT_STAT_MMARV) && inStackGuard(taskCurrent, memAdr)) ||
+       ((mfault & NVIC_FAULT_STAT_MSTKE) && inStackGuard(taskCurrent, (uint32_t)PSP))) {
+        putsUart0(RED_TXT);
+        putsUart0("Stack overflow\n");
+        putsUart0(DFLT_TXT);
+        putsUart0("------------------\n");
+    }
+
+    // Stacking failed (MSTKE): the frame was never written, its PC slot still holds stack paint
+    if(mfault & NVIC_FAULT_STAT_MSTKE) {
+        logKernel(LOG_MPU_FAULT, 4, (uint32_t)getPID(), memAdr, 0, mfault);
+
+        putsUart0("------------------\n");
+        putsUart0("No frame, fault while stacking\n");            // MMAR is not valid either
+        putsUart0("------------------\n");
+    }
+    else {
+        // Also, print the offending instruction and data addresses.
+        uint16_t instr = *( (uint32_t *)(*(PSP+6)));
+
+        logKernel(LOG_MPU_FAULT, 4, (uint32_t)getPID(), memAdr, *(PSP+6), mfault);
+
+        putsUart0("------------------\n");
+        display("ofsIns: 0x", instr, 1, 8);
+        display("memAdr: 0x", memAdr, 1, 8);
+        putsUart0("------------------\n");
+
+        // Display the process stack dump (xPSR, PC, LR, R0-3, R12.
+        stackDump(PSP);
+    }
 
     // Kill thread that caused the fault
     taskKill(taskCurrent);
@@ -0,0 +1,148 @@
+// Number formatting
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Decimal conversion without division: two digits per step, n / 100 is done as a
+// multiply by the reciprocal (0x51EB851F / 2^37, exact for every 32-bit n) and the two
+// digits come from a pair table in flash
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include "fmt.h"
+
+#define DIV100(n)   ((uint32_t)(((uint64_t)(n) * 0x51EB851F) >> 37))
+
+const char digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+const char hexDigits[] = "0123456789ABCDEF";
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Number of decimal digits of n, compares only
+uint8_t fmtCount(uint32_t n)
+{
+    if(n >= 100000) {
+        if(n >= 10000000)
+            return (n >= 1000000000) ? 10 : (n >= 100000000) ? 9 : 8;
+        return (n >= 1000000) ? 7 : 6;
+    }
+    if(n >= 1000)
+        return (n >= 10000) ? 5 : 4;
+    return (n >= 100) ? 3 : (n >= 10) ? 2 : 1;
+}
+
+// Write the digits of n so that the last one lands at end[-1]
+void fmtDigits(char *end, uint32_t n)
+{
+    uint32_t q, r;
+
+    while(n >= 100) {
+        q = DIV100(n);
+        r = (n - q*100) * 2;
+        *--end = digitPairs[r+1];
+        *--end = digitPairs[r];
+        n = q;
+    }
+    if(n >= 10) {
+        *--end = digitPairs[n*2+1];
+        *--end = digitPairs[n*2];
+    }
+    else
+        *--end = '0' + n;
+}
+
+uint8_t fmtUint(char *buf, uint32_t n, uint8_t width, char pad)
+{
+    uint8_t len = fmtCount(n), i = 0;
+
+    while(width > len + i)
+        buf[i++] = pad;
+    len += i;
+    fmtDigits(buf + len, n);
+    buf[len] = 0;
+    return len;
+}
+
+// Sign goes before '0' padding and after ' ' padding
+uint8_t fmtInt(char *buf, int32_t n, uint8_t width, char pad)
+{
+    uint32_t mag = (uint32_t)0 - (uint32_t)n;
+    uint8_t len, i = 0;
+
+    if(n >= 0)
+        return fmtUint(buf, n, width, pad);
+
+    if(pad == '0') {
+        buf[0] = '-';
+        return 1 + fmtUint(buf + 1, mag, width ? width - 1 : 0, '0');
+    }
+    len = fmtCount(mag) + 1;
+    while(width > len + i)
+        buf[i++] = ' ';
+    buf[i] = '-';
+    len += i;
+    fmtDigits(buf + len, mag);
+    buf[len] = 0;
+    return len;
+}
+
+// Upper case, zero padded to digits (1-8), 0 for as many as needed
+uint8_t fmtHex(char *buf, uint32_t n, uint8_t digits)
+{
+    uint8_t i;
+
+    if(digits == 0 || digits > 8) {
+        digits = 1;
+        while(digits < 8 && (n >> (digits*4)))
+            digits++;
+    }
+    for(i=0; i<digits; i++)
+        buf[i] = hexDigits[(n >> ((digits-1-i)*4)) & 0xF];
+    buf[i] = 0;
+    return i;
+}
+
+// n in units of 10^-decimals, e.g. 1234 with 2 decimals is "12.34" (%CPU)
+uint8_t fmtFixed(char *buf, uint32_t n, uint8_t decimals, uint8_t width)
+{
+    char tmp[12];
+    uint8_t len, i;
+
+    if(decimals > 9)
+        decimals = 9;
+    len = fmtUint(tmp, n, decimals + 1, '0');                   // at least one integer digit
+    if(decimals) {
+        tmp[len+1] = 0;
+        for(i=len; i>len-decimals; i--)
+            tmp[i] = tmp[i-1];
+        tmp[i] = '.';
+        len++;
+    }
+    i = 0;
+    while(width > len + i)
+        buf[i++] = ' ';
+    for(width=0; width<=len; width++)                           // includes NULL
+        buf[i + width] = tmp[width];
+    return len + i;
+}
@@ -0,0 +1,28 @@
+// Number formatting
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef FMT_H_
+#define FMT_H_
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// All write a NULL terminated string into buf and return its length (without the NULL).
+// width pads on the left with pad (' ' or '0') up to that many chars, 0 for none.
+// buf needs room for max(width, 11) + 1 chars
+uint8_t fmtUint(char *buf, uint32_t n, uint8_t width, char pad);
+uint8_t fmtInt(char *buf, int32_t n, uint8_t width, char pad);
+uint8_t fmtHex(char *buf, uint32_t n, uint8_t digits);
+uint8_t fmtFixed(char *buf, uint32_t n, uint8_t decimals, uint8_t width);
+
+#endif
@@ -0,0 +1,32 @@
+// Hardware abstraction layer
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// The kernel (kernel.c, mm.c, stats.c, trace.h) reaches the core registers only through this
+// header. Built with HOST_SIM defined (host/, see host/sim.c) the same sources run as a
+// Linux process: host/hal_host.h maps the registers onto simulated ones and the SVC
+// instruction onto a call into the simulator
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+#include "tm4c123gh6pm.h"
+
+// DWT cycle counter, not in tm4c123gh6pm.h
+#define DWT_CTRL_R          (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT_R        (*((volatile uint32_t *)0xE0001004))
+#define DWT_CTRL_CYCCNTENA  0x00000001
+#define NVIC_DBG_INT_TRCENA 0x01000000  // DEMCR (NVIC_DBG_INT_R) trace enable, powers the DWT
+
+#ifdef HOST_SIM
+#include "hal_host.h"
+#endif
+
+#endif
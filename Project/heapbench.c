@@ -0,0 +1,326 @@
+// Heap allocator benchmark
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Replays alloc/free traces straight through mallocFromHeap, freeToHeap and freeTask to
+// measure how the 40 sub-region heap (512 byte sub-regions in R0, R2, R3, 1024 in R1, R4)
+// fragments. Runs privileged with DWT cycle timing: on the target from main before any
+// task exists (BENCH 1), on the host from host/simbench ("heap"), so both print the same
+// line and allocator changes can be compared with tools/benchcmp:
+//   {"bench":"heap","version":1,"clock":40000000,"results":[
+//    {"name":"synthetic","min":..,"avg":..,"max":..,"ops":..,"allocs":..,"success":..,
+//     "free_avg":..,"free_max":..,"largest_min":..,"largest":[..]},...]}
+// min/avg/max are the cycles of the allocations that succeeded, success is in percent of
+// allocs and largest holds the largest free block in bytes after each 1/16 of the trace.
+// Blocks are owned by pretend tasks, so existing allocations are left alone and every
+// block a replay made is freed before it returns
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "kernel.h"
+#include "mm.h"
+#include "uart0.h"
+#include "fmt.h"
+#include "bench.h"
+#include "heapbench.h"
+
+// Only the benchmark firmware and the host sim run it, the normal firmware links none of it
+#if BENCH || defined(HOST_SIM)
+
+#define HEAP_BENCH_VERSION  1
+#define HEAP_OWNER_PID(o)   ((void *)(0x10 + (o)))  // not in flash, can't be a task's pid
+
+// Stacks of the tasks rtos.c creates, by owner
+const uint16_t heapStackSize[HEAP_OWNERS] = {512, 1024, 512, 1536, 1024, 1024, 1024, 1024, 512, 4096};
+
+// Recorded: the task stacks in the order rtos.c creates them, then the shell killing and
+// restarting tasks while it and ReadKeys hold buffers
+const HEAP_OP bootChurn[] = {
+    {'S', 0, 0, 512},  {'S', 1, 1, 1024}, {'S', 2, 2, 512},  {'S', 3, 3, 1536}, {'S', 4, 4, 1024},
+    {'S', 5, 5, 1024}, {'S', 6, 6, 1024}, {'S', 7, 7, 1024}, {'S', 8, 8, 512},  {'S', 9, 9, 4096},
+    {'A', 10, 9, 256}, {'K', 0, 8, 0},    {'S', 8, 8, 512},  {'K', 0, 1, 0},    {'A', 11, 4, 700},
+    {'S', 1, 1, 1024}, {'K', 0, 7, 0},    {'A', 12, 9, 2048}, {'S', 7, 7, 1024}, {'F', 10, 0, 0},
+    {'K', 0, 3, 0},    {'S', 3, 3, 1536}, {'F', 11, 0, 0},   {'K', 0, 9, 0},    {'S', 9, 9, 4096},
+    {'A', 10, 9, 256}, {'F', 10, 0, 0},   {'K', 0, 1, 0},    {'K', 0, 8, 0},    {'S', 1, 1, 1024},
+    {'S', 8, 8, 512},  {'A', 13, 2, 3000},
+};
+
+const HEAP_TRACE heapTraces[] = {
+    {"boot_churn", bootChurn, sizeof(bootChurn)/sizeof(bootChurn[0]), 0, 0},
+    {"synthetic", 0, 2000, 1, 0},
+    {"restart_churn", 0, 2000, 2, 20},
+};
+#define HEAP_TRACE_COUNT    (sizeof(heapTraces)/sizeof(heapTraces[0]))
+
+void *heapSlot[HEAP_SLOTS];
+uint8_t heapSlotOwner[HEAP_SLOTS];
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+uint32_t heapRandom(uint32_t *seed)
+{
+    uint32_t x = *seed;                         // xorshift32, same sequence on host and target
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+// Next empty slot at or after a random one, HEAP_SLOTS if all are full
+uint8_t heapEmptySlot(uint32_t *seed)
+{
+    uint8_t i, s = heapRandom(seed) % HEAP_SLOTS;
+
+    for(i=0; i<HEAP_SLOTS; i++, s = (s + 1) % HEAP_SLOTS)
+        if(!heapSlot[s])
+            return s;
+    return HEAP_SLOTS;
+}
+
+// One synthetic step into op[], 2 ops for a restart. Sizes are mostly one sub-region,
+// some span a region edge and a few need most of a region
+uint8_t heapSynthetic(uint32_t *seed, uint8_t restartPct, HEAP_OP op[])
+{
+    uint8_t i, live = 0, s, owner, kind;
+
+    for(i=0; i<HEAP_SLOTS; i++)
+        live += heapSlot[i] != 0;
+
+    owner = heapRandom(seed) % HEAP_OWNERS;
+    if(heapRandom(seed) % 100 < restartPct) {
+        op[0].type = HEAP_KILL;
+        op[0].owner = owner;
+        for(s=0; s<HEAP_SLOTS && heapSlot[s] && heapSlotOwner[s] != owner; s++);
+        if(s == HEAP_SLOTS)                     // nowhere to put the new stack
+            return 1;
+        op[1].type = HEAP_STACK;
+        op[1].slot = s;
+        op[1].owner = owner;
+        op[1].size = heapStackSize[owner];
+        return 2;
+    }
+
+    if(live == 0 || (live < HEAP_SLOTS && heapRandom(seed) % 2)) {
+        op[0].type = HEAP_ALLOC;
+        op[0].slot = heapEmptySlot(seed);
+        op[0].owner = owner;
+        kind = heapRandom(seed) % 16;
+        if(kind < 10)
+            op[0].size = 16 + heapRandom(seed) % (512 - 16 + 1);
+        else if(kind < 14)
+            op[0].size = 513 + heapRandom(seed) % (1536 - 513 + 1);
+        else
+            op[0].size = 1537 + heapRandom(seed) % (8192 - 1537 + 1);
+        return 1;
+    }
+
+    s = heapRandom(seed) % HEAP_SLOTS;
+    while(!heapSlot[s])
+        s = (s + 1) % HEAP_SLOTS;
+    op[0].type = HEAP_FREE;
+    op[0].slot = s;
+    return 1;
+}
+
+// Free the block in slot the way freeHandle does, returns the cycles it took
+uint32_t heapFreeSlot(uint8_t slot)
+{
+    uint32_t t;
+    int8_t idx;
+
+    t = DWT_CYCCNT_R;
+    idx = findHCB(heapSlot[slot]);
+    if(idx >= 0) {
+        freeTask(idx);
+        numAllocs--;
+    }
+    t = DWT_CYCCNT_R - t;
+    heapSlot[slot] = 0;
+    return t;
+}
+
+// Every block of owner at once, the kill path of the kernel. 0 cycles if it had none
+uint32_t heapKill(uint8_t owner)
+{
+    uint32_t t = 0;
+    uint8_t i;
+
+    for(i=0; i<numAllocs && HCB_table[i].PID != HEAP_OWNER_PID(owner); i++);
+    if(i < numAllocs) {
+        t = DWT_CYCCNT_R;
+        freeToHeap(HCB_table[i].SP);
+        t = DWT_CYCCNT_R - t;
+    }
+    for(i=0; i<HEAP_SLOTS; i++)
+        if(heapSlot[i] && heapSlotOwner[i] == owner)
+            heapSlot[i] = 0;
+    return t;
+}
+
+void heapAddFree(HEAP_RESULT *r, uint32_t cycles)
+{
+    r->frees++;
+    r->freeSum += cycles;
+    if(cycles > r->freeMax)
+        r->freeMax = cycles;
+}
+
+void heapApply(const HEAP_OP *op, HEAP_RESULT *r)
+{
+    uint16_t guard;
+    uint32_t t;
+    void *top;
+    void *p;
+
+    if(op->type != HEAP_KILL && op->slot >= HEAP_SLOTS)
+        return;
+
+    switch(op->type) {
+        case HEAP_ALLOC:
+        case HEAP_STACK:
+            if(op->owner >= HEAP_OWNERS)
+                return;
+            if(heapSlot[op->slot])
+                heapAddFree(r, heapFreeSlot(op->slot));
+            t = DWT_CYCCNT_R;
+            if(op->type == HEAP_STACK && STACK_GUARD)
+                p = mallocGuardedStack(op->size, &guard, &top);
+            else
+                p = mallocFromHeap(op->size);
+            t = DWT_CYCCNT_R - t;
+            r->allocs++;
+            if(!p)
+                return;
+            HCB_table[numAllocs-1].PID = HEAP_OWNER_PID(op->owner);     // allocators append their entry last
+            heapSlot[op->slot] = p;
+            heapSlotOwner[op->slot] = op->owner;
+            r->allocOk++;
+            r->allocSum += t;
+            if(t < r->allocMin)
+                r->allocMin = t;
+            if(t > r->allocMax)
+                r->allocMax = t;
+            break;
+        case HEAP_FREE:
+            if(heapSlot[op->slot])
+                heapAddFree(r, heapFreeSlot(op->slot));
+            break;
+        case HEAP_KILL:
+            if(op->owner < HEAP_OWNERS)
+                heapAddFree(r, heapKill(op->owner));
+            break;
+    }
+}
+
+// Replays trace into r, then frees whatever the trace left allocated.
+// Returns false if the trace had no ops
+bool heapReplay(const HEAP_TRACE *trace, HEAP_RESULT *r)
+{
+    uint32_t seed = trace->seed ? trace->seed : 1;
+    uint16_t i = 0, largest;
+    uint8_t n, k, o;
+    uint32_t j;
+    HEAP_OP op[2];
+
+    r->name = trace->name;
+    r->ops = r->allocs = r->allocOk = r->frees = 0;
+    r->allocMin = 0xFFFFFFFF;
+    r->allocMax = r->freeMax = 0;
+    r->allocSum = r->freeSum = 0;
+    r->largestMin = largestFreeBlock();
+    for(k=0; k<HEAP_SAMPLES; k++)
+        r->largest[k] = r->largestMin;
+    for(k=0; k<HEAP_SLOTS; k++)
+        heapSlot[k] = 0;
+
+    if(!trace->count)
+        return false;
+
+    while(i < trace->count) {
+        if(trace->ops) {
+            op[0] = trace->ops[i];
+            n = 1;
+        }
+        else
+            n = heapSynthetic(&seed, trace->restartPct, op);
+
+        for(k=0; k<n && i < trace->count; k++, i++) {
+            heapApply(&op[k], r);
+            largest = largestFreeBlock();
+            if(largest < r->largestMin)
+                r->largestMin = largest;
+            for(j = (uint32_t)i * HEAP_SAMPLES / trace->count; j < (uint32_t)(i + 1) * HEAP_SAMPLES / trace->count; j++)
+                r->largest[j] = largest;                // the last op of each 1/16, all of them for short traces
+        }
+    }
+    r->ops = i;
+
+    for(o=0; o<HEAP_OWNERS; o++)
+        heapKill(o);
+    if(r->allocMin == 0xFFFFFFFF)
+        r->allocMin = 0;
+    return true;
+}
+
+void putHeapResults(HEAP_RESULT r[], uint8_t count)
+{
+    char str[12];
+    uint8_t i, k;
+
+    putsUart0("{\"bench\":\"heap\",\"version\":");
+    fmtUint(str, HEAP_BENCH_VERSION, 0, ' ');
+    putsUart0(str);
+    putJsonUint("clock", 40000000);
+    putsUart0(",\"results\":[");
+    for(i=0; i<count; i++) {
+        putsUart0(i ? ",{\"name\":\"" : "{\"name\":\"");
+        putsUart0((char *)r[i].name);
+        putsUart0("\"");
+        putJsonUint("min", r[i].allocMin);
+        putJsonUint("avg", r[i].allocOk ? r[i].allocSum / r[i].allocOk : 0);
+        putJsonUint("max", r[i].allocMax);
+        putJsonUint("ops", r[i].ops);
+        putJsonUint("allocs", r[i].allocs);
+        putJsonUint("success", r[i].allocs ? 100 * r[i].allocOk / r[i].allocs : 100);
+        putJsonUint("free_avg", r[i].frees ? r[i].freeSum / r[i].frees : 0);
+        putJsonUint("free_max", r[i].freeMax);
+        putJsonUint("largest_min", r[i].largestMin);
+        putsUart0(",\"largest\":[");
+        for(k=0; k<HEAP_SAMPLES; k++) {
+            fmtUint(str, r[i].largest[k], 0, ' ');
+            if(k)
+                putsUart0(",");
+            putsUart0(str);
+        }
+        putsUart0("]}");
+    }
+    putsUart0("]}\n");
+}
+
+// Replays every built in trace and prints the results, privileged only
+void heapBench(void)
+{
+    HEAP_RESULT r[HEAP_TRACE_COUNT];
+    uint8_t i;
+
+    for(i=0; i<HEAP_TRACE_COUNT; i++)
+        heapReplay(&heapTraces[i], &r[i]);
+    putHeapResults(r, HEAP_TRACE_COUNT);
+}
+
+#endif
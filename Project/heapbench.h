@@ -0,0 +1,74 @@
+// Heap allocator benchmark
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef HEAPBENCH_H_
+#define HEAPBENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define HEAP_SLOTS      16                  // live blocks a trace can name (HCB table holds 19)
+#define HEAP_OWNERS     10                  // pretend tasks that own the blocks, one per rtos.c task
+#define HEAP_SAMPLES    16                  // largest free block samples over a replay
+
+// Trace operations, also the first letter of a line in a host trace file:
+//   A slot owner size      mallocFromHeap into slot (a block still in the slot is freed first)
+//   S slot owner size      task stack, allocated the way createThread does (guarded or not)
+//   F slot                 free the block in slot
+//   K owner                kill: free every block of owner as stopThread does (freeToHeap)
+// A task restart is a K followed by an S
+#define HEAP_ALLOC      'A'
+#define HEAP_STACK      'S'
+#define HEAP_FREE       'F'
+#define HEAP_KILL       'K'
+
+typedef struct _HEAP_OP {
+    uint8_t type;
+    uint8_t slot;
+    uint8_t owner;
+    uint16_t size;
+} HEAP_OP;
+
+// A recorded trace (ops) or, with ops 0, count synthetic ops from seed. Synthetic traces
+// restart a task (kill it and allocate its stack again) restartPct % of the time
+typedef struct _HEAP_TRACE {
+    const char *name;
+    const HEAP_OP *ops;
+    uint16_t count;
+    uint32_t seed;
+    uint8_t restartPct;
+} HEAP_TRACE;
+
+// Replay results, cycles are per mallocFromHeap/freeToHeap call and include any
+// compaction it triggered
+typedef struct _HEAP_RESULT {
+    const char *name;
+    uint16_t ops;
+    uint16_t allocs;
+    uint16_t allocOk;
+    uint32_t allocMin;
+    uint32_t allocMax;
+    uint64_t allocSum;
+    uint16_t frees;
+    uint32_t freeMax;
+    uint64_t freeSum;
+    uint16_t largestMin;                    // smallest largest free block seen, bytes
+    uint16_t largest[HEAP_SAMPLES];         // largest free block after each 1/16 of the ops
+} HEAP_RESULT;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+bool heapReplay(const HEAP_TRACE *trace, HEAP_RESULT *r);
+void putHeapResults(HEAP_RESULT r[], uint8_t count);
+void heapBench(void);
+
+#endif
@@ -13,12 +13,16 @@
 //-----------------------------------------------------------------------------
 
 #include <stdint.h>
-#include "tm4c123gh6pm.h"
+#include "hal.h"
 #include "mm.h"
 #include "kernel.h"
 #include "uart0.h"
 #include "asp.h"
 #include "shell.h"
+#include "log.h"
+#include "trace.h"
+#include "stats.h"
+#include "prof.h"
 
 //-----------------------------------------------------------------------------
 // RTOS Defines and Kernel Variables
@@ -54,8 +58,6 @@ semaphore semaphores[MAX_SEMAPHORES];
 #define TASK_MALLOC     7
 
 #define SHELL_REBOOT    8
-#define SHELL_PS        9
-#define SHELL_IPCS      10
 #define SHELL_KILL      11
 #define SHELL_PKILL     12
 #define SHELL_PI        13
@@ -63,31 +65,61 @@ semaphore semaphores[MAX_SEMAPHORES];
 #define SHELL_SCHED     15
 #define SHELL_PIDOF     16
 #define SHELL_RUN_PROC  17
-#define SHELL_MEMINFO   18
 
 #define RESTART_THREAD  19
 #define SET_PRIORITY    20
 
+#define HANDLE_MALLOC   21
+#define HANDLE_LOCK     22
+#define HANDLE_UNLOCK   23
+#define HANDLE_FREE     24
+#define HEAP_COMPACT    25
+#define TASK_REALLOC    26
+#define TASK_MALLOC_AL  27
+#define SHARED_CREATE   28
+#define SHARED_ATTACH   29
+#define SHARED_DETACH   30
+#define UART_WRITE      31
+#define UART_READ       32
+#define UART_KBHIT      33
+#define UART_DMA_WRITE  34
+#define UART_DMA_BUSY   35
+#define LOG_REGISTER    36
+#define LOG_FLUSH       37
+#define UART_READ_BULK  38
+#define KERNEL_SNAPSHOT 39
+#define TRACE_READ      40
+#define LAT_READ        41
+#define PROF_CONTROL    42
+#define PROF_READ       43
+#define THREAD_SPAWN    44
+#define THREAD_EXIT     45
+
 // 1ms interrupt with SysTick
 #define RELOAD_1MS      39999       // 1ms Interrupt for 40 MHz System Clock
 
-#define FIX_PCT         10e3
-#define SYS_CLK         40e6
+#define FIX_PCT         10000
+#define SYS_CLK         40000000
+#define CPU_WINDOW_CYCLES   ((uint32_t)(SYS_CLK / 1000) * CPU_SAMPLE_MS * CPU_WINDOW_SLOTS)
+#define OVERRUN_PRIORITY    14      // band a task over its budget runs in until it blocks, above Idle
+#define SPAWN_PID           0x80000000  // spawned tasks' pids count up from here, never a fn address
 
-// task states
-#define STATE_INVALID           0 // no task
-#define STATE_STOPPED           1 // stopped, all memory freed
-#define STATE_READY             2 // has run, can resume at any time
-#define STATE_DELAYED           3 // has run, but now awaiting timer
-#define STATE_BLOCKED_MUTEX     4 // has run, but now blocked by semaphore
-#define STATE_BLOCKED_SEMAPHORE 5 // has run, but now blocked by semaphore
+// Pattern stacks are painted with, first overwritten word marks the high-water mark
+#define STACK_PAINT     0xA5A5A5A5
 
 // task
 uint8_t taskCurrent = 0;          // index of last dispatched task
-uint8_t taskCount = 0;            // total number of valid tasks
+uint8_t taskCount = 0;            // tcb records used so far, a high-water mark: a detached task
+                                  // frees its record (STATE_INVALID) for the next spawn
+uint32_t spawnSeq = 0;            // spawns so far, makes each spawned pid unique
+
+// CPU accounting
+uint32_t cycleMark = 0;           // DWT_CYCCNT when the running task was last charged
+uint32_t pendSvStart = 0;         // DWT_CYCCNT at PendSV entry, a global since pendSvIsr is naked
+uint8_t cpuSlot = 0;              // window slot the next sample goes in
 
-//Ping-Pong flag
-bool ping = true;
+// Snapshot sequence, lets the shell tell copies apart
+uint32_t snapGeneration = 0;
 
 
 // control
@@ -100,8 +132,15 @@ bool preemption = true;           // preemption (true) or cooperative (false)
 struct _tcb
 {
     uint8_t state;                 // see STATE_ values above
-    void *pid;                     // used to uniquely identify thread (add of task fn)
+    bool overrun;                  // over budget this release, runs at OVERRUN_PRIORITY
+    bool detached;                 // record freed when it ends, can not be restarted
+    void *pid;                     // used to uniquely identify thread (add of task fn, or SPAWN_PID + n)
+    _fn fn;                        // entry point, PC of its first frame
+    void *arg;                     // R0 of its first frame
     void *spInit;                  // original top of stack
+    void *stackBase;               // lowest usable stack address (for high-water mark)
+    uint16_t guard;                // size of no-access guard sub-region below stackBase (0 if none)
+    uint16_t budget;               // CPU us allowed from release to blocking, 0 = unlimited
     void *sp;                      // current stack pointer
     uint8_t priority;              // 0=highest
     uint8_t currentPriority;       // 0=highest (needed for pi)
@@ -111,8 +150,11 @@ struct _tcb
     uint8_t mutex;                 // index of the mutex in use or blocking the thread
     uint8_t semaphore;             // index of the semaphore that is blocking the thread
     uint32_t size;                 // Size of task (needed for restarThread)
-    uint32_t timeElpA;             // Used for CPU%
-    uint32_t timeElpB;             // Used for CPU%
+    uint64_t cycles;               // DWT cycles run since created
+    uint32_t cyclesSampled;        // low word of cycles at the last CPU% sample
+    uint32_t releaseStart;         // low word of cycles when its current release began
+    uint32_t cycleSlot[CPU_WINDOW_SLOTS];   // cycles run in each sample of the window
+    uint32_t cpuWindow;            // sum of cycleSlot, used for CPU%
 } tcb[MAX_TASKS];
 
 //-----------------------------------------------------------------------------
@@ -152,6 +194,14 @@ void initRtos(void)
         tcb[i].pid = 0;
     }
 
+    // Event trace ring, the heap is still empty so it always gets its sub-region
+    initTrace();
+
+    // Free running cycle counter for CPU%
+    NVIC_DBG_INT_R |= NVIC_DBG_INT_TRCENA;
+    DWT_CYCCNT_R = 0;
+    DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+
     // SysTick Config
     NVIC_ST_RELOAD_R = RELOAD_1MS;
     NVIC_ST_CTRL_R |= NVIC_ST_CTRL_CLK_SRC | NVIC_ST_CTRL_INTEN | NVIC_ST_CTRL_ENABLE;
@@ -200,6 +250,7 @@ uint8_t rtosScheduler(void)
 // fn set TMPL bit, and PC <= fn
 void startRtos(void)
 {
+    logKernel(LOG_BOOT, 1, taskCount, 0, 0, 0);
     setPSP((uint32_t *)0x20008000);         // Might cause an MPU fault. Top of SRAM needs access
     setASP();
     setTMPL();
@@ -214,74 +265,52 @@ void startRtos(void)
 // initialize the created stack to make it appear the thread has run before
 bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes)
 {
-    bool ok = false;
     uint8_t i = 0;
     bool found = false;
 
-    void *baseAdd = 0;
-
-    if (taskCount < MAX_TASKS)
+    // make sure fn not already in list (prevent reentrancy)
+    while (!found && (i < MAX_TASKS))
     {
-        // make sure fn not already in list (prevent reentrancy)
-        while (!found && (i < MAX_TASKS))
-        {
-            found = (tcb[i++].pid ==  fn);
-        }
-        if (!found)
-        {
-            // find first available tcb record
-            i = 0;
-            while (tcb[i].state != STATE_INVALID) {i++;}
-            tcb[i].state = STATE_READY;
-            tcb[i].pid = fn;
-
-            baseAdd = mallocFromHeap(stackBytes);                       // Allocate space
-            taskCurrent++;
-
-            tcb[i].sp = (void *)((uint32_t)baseAdd + stackBytes);       // Top of stack
-            tcb[i].spInit = tcb[i].sp;                                  // Top of stack
-            tcb[i].priority = priority;
-            tcb[i].currentPriority = priority;
-            tcb[i].srd = createNoSramAccessMask();
-            addSramAccessWindow(&tcb[i].srd, baseAdd, stackBytes);
-
-            strgcopy(tcb[i].name, name);                                // Copy name
-
-            tcb[i].size = stackBytes;                                   // Store size
-
-            // Make it look as though it has ran before
-            uint32_t *p = tcb[i].sp;
-            *(--p) = 0x01000000;        // XPSR -> Thumb bit set
-            *(--p) = (uint32_t)fn;      // PC   -> Function address
-            *(--p) = 0x0000DEAD;        // LR
-            *(--p) = 0x0000000C;        // R12
-            *(--p) = 0x00000003;        // R3
-            *(--p) = 0x00000002;        // R2
-            *(--p) = 0x00000001;        // R1
-            *(--p) = 0x00000000;        // R0
-            *(--p) = 0x00000004;        // R4
-            *(--p) = 0x00000005;        // R5
-            *(--p) = 0x00000006;        // R6
-            *(--p) = 0x00000007;        // R7
-            *(--p) = 0x00000008;        // R8
-            *(--p) = 0x00000009;        // R9
-            *(--p) = 0x0000000A;        // R10
-            *(--p) = 0x0000000B;        // R11
-            *(--p) = 0xFFFFFFFD;        // LR
-            tcb[i].sp = (void *)p;                                      // Update SP
-
-            tcb[i].mutex = MAX_MUTEXES;                                 // Has no mutex
-            tcb[i].semaphore = MAX_SEMAPHORES;                          // Has no semaphore
-
-            tcb[i].timeElpA = 0;
-            tcb[i].timeElpB = 0;
-
-            // increment task count
-            taskCount++;
-            ok = true;
+        found = (tcb[i++].pid ==  fn);
+    }
+    if (found)
+        return false;
+
+    i = freeTcb();
+    return i < MAX_TASKS && taskCreate(i, fn, fn, 0, name, priority, stackBytes);
+}
+
+// Start fn as a new task at runtime, with arg in R0. Returns its pid (a handle for kill,
+// restartThread & co), or 0 if there is no free tcb record, no room for the stack or attr
+// is not readable by the caller. fn may be running already: every spawn gets its own pid.
+// When fn returns the task ends as if killed; a detached one also frees its tcb record
+void *spawnThread(_fn fn, void *arg, const THREAD_ATTR *attr)
+{
+    __asm(" SVC #44 ");
+
+    return (void *)getR0();
+}
+
+// A task function returns here (LR of its first frame), or a task can call it to end itself
+void threadExit(void)
+{
+    __asm(" SVC #45 ");
+}
+
+// Before startRtos, like createThread: CPU time fn may use from a release (wake from
+// sleep, post or unlock) to its next sleep, wait or blocking lock. Past it the task is
+// logged and demoted to OVERRUN_PRIORITY until it blocks. 0 removes the budget
+bool setThreadBudget(_fn fn, uint16_t us)
+{
+    uint8_t i;
+
+    for(i=0; i<taskCount; i++) {
+        if(tcb[i].pid == fn) {
+            tcb[i].budget = us;
+            return true;
         }
     }
-    return ok;
+    return false;
 }
 
 // REQUIRED: modify this function to restart a thread
@@ -340,6 +369,104 @@ void post(int8_t semaphore)
     __asm(" SVC #6 ");
 }
 
+// UART0 ring buffer access for tasks (ring lives in kernel memory)
+uint16_t _writeUart0(const char *str)
+{
+    __asm(" SVC #31 ");
+
+    return getR0();
+}
+
+int16_t _readUart0(void)
+{
+    __asm(" SVC #32 ");
+
+    return getR0();
+}
+
+bool _kbhitUart0(void)
+{
+    __asm(" SVC #33 ");
+
+    return getR0();
+}
+
+// Queue a uDMA block: 1 queued, 0 channel busy (wait on uartDmaDone), -1 not caller's memory
+int8_t _writeUart0Dma(const void *data, uint16_t len)
+{
+    __asm(" SVC #34 ");
+
+    return getR0();
+}
+
+bool _uart0DmaBusy(void)
+{
+    __asm(" SVC #35 ");
+
+    return getR0();
+}
+
+// Register the calling task's log ring (see logOpen)
+bool _logRegister(void *ring)
+{
+    __asm(" SVC #36 ");
+
+    return getR0();
+}
+
+// Read up to max chars from the UART0 RX ring, 0 if empty
+uint8_t _readUart0Bulk(char *buf, uint8_t max)
+{
+    __asm(" SVC #38 ");
+
+    return getR0();
+}
+
+// Copy the newest trace events (at most max) oldest first, returns how many, 0 if tracing
+// is compiled out
+uint16_t _traceRead(TRACE_EVENT *buf, uint16_t max)
+{
+    __asm(" SVC #40 ");
+
+    return getR0();
+}
+
+// Copy the latency histograms, reset clears them but keeps the worst cases
+bool _latRead(struct _LAT_HIST *buf, bool reset)
+{
+    __asm(" SVC #41 ");
+
+    return getR0();
+}
+
+// Start, stop or clear the sampling profiler, op is PROF_ON, PROF_OFF or PROF_RESET
+void _profControl(uint8_t op)
+{
+    __asm(" SVC #42 ");
+}
+
+// Copy the profiler counts, false if buf is not writable by the caller
+bool _profRead(struct _PROF_DATA *buf)
+{
+    __asm(" SVC #43 ");
+
+    return getR0();
+}
+
+// Copy kernel state for ps, ipcs & meminfo, false if snap is not writable by the caller
+bool _snapshot(struct _SNAPSHOT *snap)
+{
+    __asm(" SVC #39 ");
+
+    return getR0();
+}
+
+// Send pending log records of all tasks, as much as fits in the UART TX ring
+void _logFlush(void)
+{
+    __asm(" SVC #37 ");
+}
+
 // mallocFromHeap: Wrapper function
 void *_mallocFromHeap(uint32_t size) {
     __asm(" SVC #7 ");
@@ -347,6 +474,68 @@ void *_mallocFromHeap(uint32_t size) {
     return (void *)getR0();
 }
 
+// reallocFromHeap: Wrapper function, data is preserved. Returns 0 on failure (old block kept)
+void *_reallocFromHeap(void *pMemory, uint32_t size) {
+    __asm(" SVC #26 ");
+
+    return (void *)getR0();
+}
+
+// alignedMallocFromHeap: Wrapper function, alignment must be a power of 2
+void *_alignedMallocFromHeap(uint32_t size, uint32_t alignment) {
+    __asm(" SVC #27 ");
+
+    return (void *)getR0();
+}
+
+// createSharedRegion: Wrapper function, other tasks attach to the region with key
+void *_createSharedRegion(uint16_t key, uint32_t size) {
+    __asm(" SVC #28 ");
+
+    return (void *)getR0();
+}
+
+// attachSharedRegion: Wrapper function, returns base address of the region created with key (0 if none)
+void *_attachSharedRegion(uint16_t key) {
+    __asm(" SVC #29 ");
+
+    return (void *)getR0();
+}
+
+// detachSharedRegion: Wrapper function, memory is freed once the last user detaches
+void _detachSharedRegion(void *pMemory) {
+    __asm(" SVC #30 ");
+}
+
+// mallocHandle: Wrapper function, returns handle of a relocatable block (NO_HANDLE on failure)
+uint8_t _mallocHandle(uint32_t size) {
+    __asm(" SVC #21 ");
+
+    return getR0();
+}
+
+// lockHandle: Wrapper function, pins block and returns its current address
+void *_lockHandle(uint8_t handle) {
+    __asm(" SVC #22 ");
+
+    return (void *)getR0();
+}
+
+// unlockHandle: Wrapper function, block may be moved again by compaction
+void _unlockHandle(uint8_t handle) {
+    __asm(" SVC #23 ");
+}
+
+// freeHandle: Wrapper function
+void _freeHandle(uint8_t handle) {
+    __asm(" SVC #24 ");
+}
+
+// compactHeap: Wrapper function, compacts only if heap is fragmented past FRAG_THRESHOLD
+void _compactHeap(void) {
+    __asm(" SVC #25 ");
+}
+
 // REQUIRED: modify this function to add support for the system timer
 // REQUIRED: in preemptive code, add code to request task switch
 void systickIsr(void)
@@ -354,36 +543,109 @@ void systickIsr(void)
     static uint16_t ms = 0;
     uint8_t i;
 
+    latRecord(LAT_SYSTICK, RELOAD_1MS - NVIC_ST_CURRENT_R);    // Counter reloaded when it raised the interrupt
+    TRACE(TR_ISR, getIPSR());
+
     for(i=0; i<taskCount; i++) {
+        statsTick(i, tcb[i].state);             // Time in each state, before a wake changes it
+
         if(tcb[i].state == STATE_DELAYED) {     // Check if task has to sleep
 
             tcb[i].ticks--;                     // Decrement once --> -1ms
 
-            if(tcb[i].ticks == 0)               // If sleep time has expired
+            if(tcb[i].ticks == 0) {             // If sleep time has expired
                 tcb[i].state = STATE_READY;     // Task is now ready
+                TRACE(TR_WAKE, i);
+                statsReady(i, LAT_WAKE_SLEEP);
+            }
         }
     }
 
-    ms++;
+    if(++ms == CPU_SAMPLE_MS) {                 // Next slot of the CPU% window
+        ms = 0;
+        sampleCpu();
+    }
+
+    checkBudget(false);                         // Runaway code is caught within a ms
 
-    if(ms == 1000) {                            // When a seconds elapses
-        ms = 0;                                 // Zero out ms
+    if(preemption)
+        NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;   // if pre-emption Yield
 
-        ping = !ping;                           // swap flag, (tells buffer to write to)
+}
 
-        if(ping) {                              // if ping we using A, so clear old data
-            for(i=0; i<taskCount; i++)
-                tcb[i].timeElpA = 0;
-        }
-        else {                                  // else pong we using B, so clear old data
-            for(i=0; i<taskCount; i++)
-                tcb[i].timeElpB = 0;
+// Charge the cycles since the last charge to the running task, one DWT read.
+// CYCCNT wraps every 107 s, far longer than a task can run between systicks
+void chargeCycles(void)
+{
+    uint32_t now = DWT_CYCCNT_R;
+
+    tcb[taskCurrent].cycles += now - cycleMark;
+    cycleMark = now;
+}
+
+// Count, log and trace a release of the running task that went over its budget, once per
+// release. Still running, it is demoted so it can only take CPU nobody else wants until
+// it blocks. A lock held by a demoted task can still raise it through pi
+void checkBudget(bool blocking)
+{
+    uint32_t used;
+
+    if(!tcb[taskCurrent].budget || tcb[taskCurrent].overrun)
+        return;
+
+    used = (uint32_t)tcb[taskCurrent].cycles + (DWT_CYCCNT_R - cycleMark) - tcb[taskCurrent].releaseStart;
+    if(used <= tcb[taskCurrent].budget * (SYS_CLK / 1000000))
+        return;
+
+    statsOverrun(taskCurrent);
+    TRACE(TR_OVERRUN, used / (SYS_CLK / 1000000));
+    logKernel(LOG_OVERRUN, 3, taskCurrent, (uint32_t)tcb[taskCurrent].pid, used, 0);
+    if(blocking)
+        return;
+
+    tcb[taskCurrent].overrun = true;
+    if(tcb[taskCurrent].currentPriority < OVERRUN_PRIORITY)
+        tcb[taskCurrent].currentPriority = OVERRUN_PRIORITY;
+}
+
+// PendSV, the task leaving the CPU (already charged): a sleep, wait or blocking lock ends
+// its release, which also ends a demotion
+void switchOut(void)
+{
+    uint8_t state = tcb[taskCurrent].state;
+    uint32_t exec = 0;
+
+    if(state != STATE_READY) {
+        checkBudget(true);
+        if(tcb[taskCurrent].overrun) {
+            tcb[taskCurrent].overrun = false;
+            if(tcb[taskCurrent].currentPriority == OVERRUN_PRIORITY)
+                tcb[taskCurrent].currentPriority = tcb[taskCurrent].priority;
         }
+        exec = (uint32_t)tcb[taskCurrent].cycles - tcb[taskCurrent].releaseStart;
+        tcb[taskCurrent].releaseStart = (uint32_t)tcb[taskCurrent].cycles;  // Runs no more until the next release
     }
+    statsSwitchOut(state, exec);
+}
 
-    if(preemption)
-        NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;   // if pre-emption Yield
+// Called every CPU_SAMPLE_MS: the cycles each task ran since the last sample replace its
+// oldest slot, so cpuWindow is a moving sum over the last CPU_WINDOW_SLOTS samples
+void sampleCpu(void)
+{
+    uint32_t run;
+    uint8_t i;
+
+    chargeCycles();                                     // include the running task up to now
+
+    for(i=0; i<taskCount; i++) {
+        run = (uint32_t)tcb[i].cycles - tcb[i].cyclesSampled;
+        tcb[i].cyclesSampled = (uint32_t)tcb[i].cycles;
+        tcb[i].cpuWindow += run - tcb[i].cycleSlot[cpuSlot];
+        tcb[i].cycleSlot[cpuSlot] = run;
+    }
 
+    if(++cpuSlot == CPU_WINDOW_SLOTS)
+        cpuSlot = 0;
 }
 
 // REQUIRED: in coop and preemptive, modify this function to add support for task switching
@@ -391,6 +653,8 @@ void systickIsr(void)
 __attribute__((naked))
 void pendSvIsr(void)
 {
+    pendSvStart = DWT_CYCCNT_R;                         // Naked, no locals
+
     // If the MPU DERR or IERR bits are set, clear them
     if(NVIC_FAULT_STAT_R & (NVIC_FAULT_STAT_DERR | NVIC_FAULT_STAT_IERR)) {
         NVIC_FAULT_STAT_R = NVIC_FAULT_STAT_DERR | NVIC_FAULT_STAT_IERR;
@@ -400,35 +664,43 @@ void pendSvIsr(void)
     pushRegsOnPSP();
     tcb[taskCurrent].sp = getPSP();                     // save PSP
 
-    WTIMER0_CTL_R &= ~TIMER_CTL_TAEN;                   // End timer
-
-    if(ping)                                            // If ping, Write to A
-        tcb[taskCurrent].timeElpA += WTIMER0_TAV_R;
-    else                                                // Else pong, Write to B
-        tcb[taskCurrent].timeElpB += WTIMER0_TAV_R;
+    chargeCycles();                                     // CPU time of the task switched out
+    switchOut();                                        // Ends its release if it blocked
 
     taskCurrent = rtosScheduler();                      // Call Scheduler
-
-    WTIMER0_TAV_R = 0;                                  // Zero out timer
-    WTIMER0_CTL_R |= TIMER_CTL_TAEN;                    // Start Timer
+    TRACE(TR_SWITCH, tcb[taskCurrent].currentPriority);
+    statsSwitchIn();                                    // Switch counts and release-to-run
 
     applySramAccessMask(tcb[taskCurrent].srd);          // Restore SRD bits for next task
     setPSP(tcb[taskCurrent].sp);                        // Restore PSP
 
     tcb[taskCurrent].sp = (void *)(getPSP() + 9);       // About to POP 9 regs, update accordingly
+    latRecord(LAT_PENDSV, DWT_CYCCNT_R - pendSvStart);
     popRegsOnPSP();
 }
 
-// REQUIRED: modify this function to add support for the service call
-// REQUIRED: in preemptive code, add code to handle synchronization primitives
+// Entry and exit are traced and timed here, svCall has returns all over its cases
 void svCallIsr(void)
 {
+    uint32_t start = DWT_CYCCNT_R;
     uint32_t *PSP = getPSP();
     uint8_t *PC = (uint8_t *)(*(PSP+6));                        // Get PC
     uint8_t svcNum = *(PC-2);                                   // Get SVC Number
 
+    TRACE(TR_SVC, svcNum);
+    svCall(svcNum);
+    TRACE(TR_SVC_EXIT, svcNum);
+    latRecord(LAT_SVC, DWT_CYCCNT_R - start);
+}
+
+// REQUIRED: modify this function to add support for the service call
+// REQUIRED: in preemptive code, add code to handle synchronization primitives
+void svCall(uint8_t svcNum)
+{
+    uint32_t *PSP = getPSP();
+
     // Variable often used in most switch cases
-    uint8_t i, j, k;
+    uint8_t i;
     uint8_t mutex;
     uint8_t sema;
     uint8_t *q;
@@ -439,7 +711,7 @@ void svCallIsr(void)
     switch(svcNum) {
         case RTOS_START: {                                      // Start RTOS
             taskCurrent = rtosScheduler();                      // Call Scheduler
-            WTIMER0_CTL_R |= TIMER_CTL_TAEN;
+            cycleMark = DWT_CYCCNT_R;                           // First task is charged from here
             applySramAccessMask(tcb[taskCurrent].srd);          // Restore SRD bits for next task
             setPSP(tcb[taskCurrent].sp);                        // Restore PSP
             tcb[taskCurrent].sp = (void *)(getPSP() + 9);       // About to POP 9 Regs
@@ -447,6 +719,7 @@ void svCallIsr(void)
             break;
         }
         case TASK_SWITCH: {                                     // Task Switching
+            statsYield();                                       // Still ready, but gave the CPU up
             NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;           // PendSV call
             break;
         }
@@ -464,8 +737,10 @@ void svCallIsr(void)
             if(!mutexes[mutex].lock) {                          // If free
                 mutexes[mutex].lock = true;                     // lock it
                 mutexes[mutex].lockedBy = taskCurrent;          // Lock by current task
+                TRACE(TR_LOCK, mutex);
             }
             else {                                              // else
+                TRACE(TR_LOCK, mutex | TRACE_BLOCKED);
                 if(priorityInheritance) {
                     if(tcb[mutexes[mutex].lockedBy].priority > tcb[taskCurrent].priority)           // If whoever hold it has a lower priority
                         tcb[mutexes[mutex].lockedBy].currentPriority = tcb[taskCurrent].priority;   // Elevate its priority
@@ -480,45 +755,27 @@ void svCallIsr(void)
         }
         case TASK_UNLOCK: {                                     // Unlock
             mutex = *PSP;                                       // Call taskUlock passing mutex and task
+            TRACE(TR_UNLOCK, mutex);
             taskUnlock(mutex, taskCurrent);
             break;
         }
         case TASK_WAIT: {                                       // Semaphore wait
             sema = *PSP;                                        // Get semaphore num
             tcb[taskCurrent].semaphore = sema;
-            q = semaphores[sema].processQueue;                  // ptr to queue (easier to access)
 
             if(semaphores[sema].count > 0) {                    // If there is a count
                 semaphores[sema].count--;                       // Decrement count
+                TRACE(TR_WAIT, sema);
                 return;
             }
-            else {                                                  // else
-                q[semaphores[sema].queueSize] = taskCurrent;        // Place task in queue
-                semaphores[sema].queueSize++;                       // increment size
-                tcb[taskCurrent].state = STATE_BLOCKED_SEMAPHORE;   // Set task state to semaphore blocked
-                NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;           // yield
-            }
+            else                                                    // else
+                taskBlock(sema);                                    // queue and yield
             break;
         }
         case TASK_POST: {                                       // Semaphore post
             sema = *PSP;
             tcb[taskCurrent].semaphore = sema;
-            q = semaphores[sema].processQueue;                  // ptr to queue (easier to access)
-
-            semaphores[sema].count++;                           // Increase count
-
-            if(semaphores[sema].queueSize) {                    // If there is a queue
-                i = 0;
-
-                tcb[q[i]].state = STATE_READY;                  // First on queue set to ready
-                semaphores[sema].queueSize--;                   // Decrement queue size
-                semaphores[sema].count--;                       // Decrement count
-
-                for(i=0; i<MAX_SEMAPHORE_QUEUE_SIZE-1; i++) {   // Dequeue
-                    q[i] = q[i+1];
-                }
-                q[i] = 0;
-            }
+            taskPost(sema);
             break;
         }
         case TASK_MALLOC: {                                             // Malloc From Heap
@@ -529,63 +786,164 @@ void svCallIsr(void)
             *PSP = (uint32_t)baseAdd;                                   // return based Address
             break;
         }
-        case SHELL_REBOOT: {                                    // Reboot System
-            NVIC_APINT_R = NVIC_APINT_VECTKEY | NVIC_APINT_SYSRESETREQ;
+        case TASK_REALLOC: {                                            // Realloc, SRD bits updated by reallocFromHeap
+            void *pMemory = (void *)*PSP;
+            uint32_t size = *(PSP+1);
+            if(pMemory && isStackBlock(pMemory)) {                      // Moving it would pull the stack from under the task
+                *PSP = 0;
+                break;
+            }
+            *PSP = (uint32_t)reallocFromHeap(pMemory, size);
+            applySramAccessMask(tcb[taskCurrent].srd);
             break;
         }
-        case SHELL_PS: {                                        // Print data from tcb
-            PS *p = (PS *)*PSP;                                 // Get pointer to struct on shell
-            uint64_t timeElap;
-
-            for(i=0; i<taskCount; i++) {                        // for every valid task get
-                strgcopy(p[i].name, tcb[i].name);               // name
-                p[i].PID = (uint32_t)tcb[i].pid;                // PID
-
-                if(ping)                                        
-                    timeElap = tcb[i].timeElpB;                 // if ping we writing to A, so read B
-                else
-                    timeElap = tcb[i].timeElpA;                 // if pong we writing to B, so read A
-
-                p[i].cpu = (timeElap * FIX_PCT)/SYS_CLK;        // %CPU
-
-                p[i].state = tcb[i].state;                      // state
-                p[i].sem = tcb[i].semaphore;                    // semaphore
-                p[i].mtx = tcb[i].mutex;                        // mutex
+        case TASK_MALLOC_AL: {                                          // Aligned Malloc From Heap
+            uint32_t size = *PSP;
+            uint32_t alignment = *(PSP+1);
+            void *baseAdd = alignedMallocFromHeap(size, alignment);
+            if(baseAdd) {
+                addSramAccessWindow(&tcb[taskCurrent].srd, baseAdd, size);
+                applySramAccessMask(tcb[taskCurrent].srd);
             }
-
+            *PSP = (uint32_t)baseAdd;
             break;
         }
-        case SHELL_IPCS: {                                      // Semaphore and Mutex Usage
-            IPCS *p = (IPCS *)*PSP;
-
-            for(i=0; i<MAX_SEMAPHORES; i++) {                   // Populate semaphores info
-                q = semaphores[i].processQueue;                 // ptr to queue (easier to access)
-
-                p[i].sCount = semaphores[i].count;              // Get count
-                p[i].qSize = semaphores[i].queueSize;           // Get queue size
-
-                for(j=0; j<semaphores[i].queueSize; j++)        // Of those on queue, get pids
-                    p[i].q[j] = (uint32_t)tcb[q[j]].pid;
+        case SHARED_CREATE: {                                           // Create shared region, caller is first user
+            uint16_t key = *PSP;
+            uint32_t size = *(PSP+1);
+            void *baseAdd = createSharedRegion(key, size, taskCurrent);
+            if(baseAdd) {
+                addSramAccessWindow(&tcb[taskCurrent].srd, baseAdd, size);
+                applySramAccessMask(tcb[taskCurrent].srd);
             }
+            *PSP = (uint32_t)baseAdd;
+            break;
+        }
+        case SHARED_ATTACH: {                                           // Grant caller the sub-regions of a shared region
+            uint16_t key = *PSP;
+            void *baseAdd = attachSharedRegion(key, taskCurrent);
+            if(baseAdd) {
+                addSramAccessWindow(&tcb[taskCurrent].srd, baseAdd, allocSize(baseAdd));
+                applySramAccessMask(tcb[taskCurrent].srd);
+            }
+            *PSP = (uint32_t)baseAdd;
+            break;
+        }
+        case SHARED_DETACH: {                                           // Revoke caller access, free on last user
+            void *baseAdd = (void *)*PSP;
+            uint16_t size = detachSharedRegion(baseAdd, taskCurrent);
+            if(size) {
+                removeSramAccessWindow(&tcb[taskCurrent].srd, baseAdd, size);
+                applySramAccessMask(tcb[taskCurrent].srd);
+            }
+            break;
+        }
+        case UART_WRITE: {                                      // Copy string into UART0 TX ring
+            const char *str = (const char *)*PSP;
+            uint32_t max;
+
+            if((uint32_t)str < FLASH_BASE + 0x40000)            // 256 KiB flash, all tasks read it
+                max = FLASH_BASE + 0x40000 - (uint32_t)str;
+            else
+                max = sramAccessibleLength(tcb[taskCurrent].srd, str);
+            *PSP = writeTxBuffer(str, max);
+            break;
+        }
+        case UART_READ: {                                       // Char from UART0 RX ring, -1 if empty
+            *PSP = readRxBuffer();
+            break;
+        }
+        case UART_READ_BULK: {
+            if(sramAccessible(tcb[taskCurrent].srd, (void *)*PSP, *(PSP+1)))
+                *PSP = readRxBytes((char *)*PSP, *(PSP+1));
+            else
+                *PSP = 0;
+            break;
+        }
+        case TRACE_READ: {                                      // shell trace command
+            if(sramAccessible(tcb[taskCurrent].srd, (void *)*PSP, *(PSP+1) * sizeof(TRACE_EVENT)))
+                *PSP = traceCopy((TRACE_EVENT *)*PSP, *(PSP+1));
+            else
+                *PSP = 0;
+            break;
+        }
+        case LAT_READ: {                                        // shell lat command
+            if(sramAccessible(tcb[taskCurrent].srd, (void *)*PSP, LAT_COUNT * sizeof(LAT_HIST)))
+                *PSP = latCopy((LAT_HIST *)*PSP, *(PSP+1));
+            else
+                *PSP = 0;
+            break;
+        }
+        case PROF_CONTROL: {                                    // shell prof command
+            profControl(*PSP);
+            break;
+        }
+        case PROF_READ: {
+            PROF_DATA *prof = (PROF_DATA *)*PSP;
+            *PSP = sramAccessible(tcb[taskCurrent].srd, prof, sizeof(PROF_DATA));
+            if(*PSP)
+                profCopy(prof);
+            break;
+        }
+        case THREAD_SPAWN: {                                    // R0 fn, R1 arg, R2 attributes
+            *PSP = (uint32_t)taskSpawn((_fn)*PSP, (void *)*(PSP+1), (const THREAD_ATTR *)*(PSP+2));
+            break;
+        }
+        case THREAD_EXIT: {                                     // threadExit, fn returned or ended itself
+            logKernel(LOG_EXITED, 2, taskCurrent, (uint32_t)tcb[taskCurrent].pid, 0, 0);
+            taskEnd(taskCurrent);
+            NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;           // Never runs again, switch
+            break;
+        }
+        case KERNEL_SNAPSHOT: {                                 // ps, ipcs & meminfo all render from this copy
+            SNAPSHOT *snap = (SNAPSHOT *)*PSP;
+            *PSP = sramAccessible(tcb[taskCurrent].srd, snap, sizeof(SNAPSHOT));
+            if(*PSP)
+                fillSnapshot(snap);
+            break;
+        }
+        case UART_KBHIT: {
+            *PSP = !rxBufferEmpty();
+            break;
+        }
+        case UART_DMA_WRITE: {                                  // uDMA reads past the MPU, so check the range here
+            if(sramAccessible(tcb[taskCurrent].srd, (void *)*PSP, *(PSP+1)))
+                *PSP = writeDmaBlock((const void *)*PSP, *(PSP+1));
+            else
+                *PSP = (uint32_t)-1;
+            break;
+        }
+        case UART_DMA_BUSY: {
+            *PSP = uart0DmaBusy();
+            break;
+        }
+        case LOG_REGISTER: {
+            LOG_RING *ring = (LOG_RING *)*PSP;
+            *PSP = logRingAccessible(tcb[taskCurrent].srd, ring);
+            if(*PSP)
+                logRegister(taskCurrent, ring);
+            break;
+        }
+        case LOG_FLUSH: {
+            LOG_RING *ring;
 
-            for(j=0; j<MAX_MUTEXES; j++) {                      // Then populate mutex info
-                q = mutexes[j].processQueue;                    // ptr to queue (easier to access)
-
-                p[i+j].mLock = mutexes[j].lock;                 // Get state of mutex
-                p[i+j].qSize = mutexes[j].queueSize;            // Get queue size
-
-                for(k=0; k<mutexes[j].queueSize; k++)           // Of those on queue, get pids
-                    p[i+j].q[k] = (uint32_t)tcb[q[k]].pid;
-                                                                // Get pid of the one locking it
-                p[i+j].mLockedBy = (uint32_t)tcb[mutexes[j].lockedBy].pid;
+            for(i=0; i<MAX_TASKS; i++) {                        // Ring memory may have been freed or moved since
+                ring = logRingOf(i);
+                if(ring && !logRingAccessible(tcb[i].srd, ring))
+                    logRelease(i);
             }
+            logFlushRecords();
+            break;
+        }
+        case SHELL_REBOOT: {                                    // Reboot System
+            NVIC_APINT_R = NVIC_APINT_VECTKEY | NVIC_APINT_SYSRESETREQ;
             break;
         }
         case SHELL_KILL: {                                      // kill based on PID
             pid = (void *)*PSP;                                 // Get task PID
 
             for(i=0; i<taskCount; i++) {                        // Iterate thru tcb looking for PID match
-                if(tcb[i].pid == pid) {
+                if(tcb[i].pid == pid && tcb[i].state != STATE_INVALID) {
                     if(tcb[i].state != STATE_STOPPED) {         // Make sure task hasn't already been killed
                         taskKill(i);                            // Once found, kill task
                         *PSP = 1;                               // Return success flag
@@ -659,23 +1017,11 @@ void svCallIsr(void)
             *PSP = 0;                                           // No name match, set failure flag
             break;
         }
-        case SHELL_MEMINFO: {                                   // print threads memory usage info
-            MEM *mem = (MEM *)*PSP;
-
-            for(i=0; i<HCB_MAX_SIZE; i++) {                     // Iterate thru HCB
-                if(HCB_table[i].size) {                         // If there is a size, look at its metadata
-                    mem[i].pid = (uint32_t)HCB_table[i].PID;    // Store PID
-                    mem[i].baseAdd = (uint32_t)HCB_table[i].ptr;// Store base address
-                    mem[i].size = HCB_table[i].size;            // Store size of allocation
-                }
-            }
-            break;
-        }
         case RESTART_THREAD: {
             pid = (void *)*PSP;
 
             for(i=0; i<taskCount; i++) {                        // Iterate thru tcb looking for PID match
-                if(tcb[i].pid == pid) {
+                if(tcb[i].pid == pid && tcb[i].state != STATE_INVALID) {
                     if(tcb[i].state == STATE_STOPPED) {         // Only if task has been killed
                         taskRestart(i);                         // Restart it
                         return;
@@ -689,13 +1035,38 @@ void svCallIsr(void)
             uint8_t prio = *(PSP+1);
 
             for(i=0; i<taskCount; i++) {                        // Iterate thru tcb looking for name match
-                if(tcb[i].pid == pid) {
+                if(tcb[i].pid == pid && tcb[i].state != STATE_INVALID) {
                     tcb[i].currentPriority = prio;              // Once found, set priority passed
                     return;
                 }
             }
             break;
         }
+        case HANDLE_MALLOC: {                                   // Relocatable malloc, SRD bits updated by mallocHandle
+            uint32_t size = *PSP;
+            *PSP = mallocHandle(size);
+            applySramAccessMask(tcb[taskCurrent].srd);
+            break;
+        }
+        case HANDLE_LOCK: {                                     // Pin block & return address
+            *PSP = (uint32_t)lockHandle(*PSP);
+            break;
+        }
+        case HANDLE_UNLOCK: {
+            unlockHandle(*PSP);
+            break;
+        }
+        case HANDLE_FREE: {
+            freeHandle(*PSP);
+            applySramAccessMask(tcb[taskCurrent].srd);
+            break;
+        }
+        case HEAP_COMPACT: {                                    // Called from low priority task, only compact when needed
+            if(heapFragmentation() >= FRAG_THRESHOLD)
+                compactHeap();
+            applySramAccessMask(tcb[taskCurrent].srd);
+            break;
+        }
         default:
             putsUart0("Somehow we got here... :(\n");
             break;
@@ -716,6 +1087,8 @@ void taskUnlock(uint8_t mutex, uint8_t task)
 
         if(mutexes[mutex].queueSize) {                  // if there is a queue
             tcb[q[i]].state = STATE_READY;              // First on queue is set to ready
+            TRACE(TR_WAKE, q[i]);
+            statsReady(q[i], LAT_WAKE_TASK);
             mutexes[mutex].lockedBy = q[i];             // Mutex now locked by first on queue
             mutexes[mutex].queueSize--;                 // Decrement queue size
 
@@ -736,28 +1109,192 @@ void taskUnlock(uint8_t mutex, uint8_t task)
 }
 
 
-// REQUIRED: Restart Thread
-void taskRestart(uint8_t task) {
-    uint8_t curr = taskCurrent;                                     // temporarily store taskCurrent
+// Semaphore post, also called from ISRs (same priority as SVC so never preempts the kernel)
+void taskPost(uint8_t semaphore)
+{
+    uint8_t *q = semaphores[semaphore].processQueue;    // ptr to queue (easier to access)
+    uint8_t i = 0;
+
+    TRACE(TR_POST, semaphore);
+    semaphores[semaphore].count++;                      // Increase count
 
-    taskCurrent = task;                                             // make currentTask = task passed, needed for logic in malloc
-    void *baseAdd = mallocFromHeap(tcb[task].size);                 // Reallocate memory
-    taskCurrent = curr;                                             // Restore currentTask
+    if(semaphores[semaphore].queueSize) {               // If there is a queue
+        tcb[q[i]].state = STATE_READY;                  // First on queue set to ready
+        TRACE(TR_WAKE, q[i]);
+        statsReady(q[i], getIPSR() == 11 ? LAT_WAKE_TASK : LAT_WAKE_ISR);  // 11 is SVCall
+        semaphores[semaphore].queueSize--;              // Decrement queue size
+        semaphores[semaphore].count--;                  // Decrement count
 
-    tcb[task].sp = (void *)((uint32_t)baseAdd + tcb[task].size);    // Reset Stack Pointer
-    tcb[task].spInit = tcb[task].sp;                                // Reset PS initial
-    addSramAccessWindow(&tcb[task].srd, baseAdd, tcb[task].size);   // Add its respective access
+        for(i=0; i<semaphores[semaphore].queueSize; i++) {  // Dequeue
+            q[i] = q[i+1];
+        }
+        q[i] = 0;
+    }
+}
+
+// Queue the running task on semaphore and switch away. The UART SVCs call this when they
+// find nothing to do, so the ISR's post can not fall between the check and the wait
+void taskBlock(uint8_t semaphore)
+{
+    TRACE(TR_WAIT, semaphore | TRACE_BLOCKED);
+    tcb[taskCurrent].semaphore = semaphore;
+    semaphores[semaphore].processQueue[semaphores[semaphore].queueSize++] = taskCurrent;
+    tcb[taskCurrent].state = STATE_BLOCKED_SEMAPHORE;   // Set task state to semaphore blocked
+    NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;           // yield
+}
+
+// Wake every task queued on semaphore without leaving a count behind (ISR event flags)
+void taskPostAll(uint8_t semaphore)
+{
+    while(semaphores[semaphore].queueSize)
+        taskPost(semaphore);
+}
+
+// First free tcb record, MAX_TASKS if none
+uint8_t freeTcb(void)
+{
+    uint8_t i = 0;
+
+    while(i < MAX_TASKS && tcb[i].state != STATE_INVALID)
+        i++;
+    return i;
+}
+
+// Fill the free tcb record i and build its stack, for createThread and spawnThread. false
+// (record left free) if the stack does not fit
+bool taskCreate(uint8_t i, void *pid, _fn fn, void *arg, const char name[], uint8_t priority, uint32_t stackBytes)
+{
+    uint8_t j;
+
+    tcb[i].pid = pid;
+    tcb[i].fn = fn;
+    tcb[i].arg = arg;
+    tcb[i].size = stackBytes;                                       // Store size
+    tcb[i].srd = createNoSramAccessMask();
+
+    if(!allocThreadStack(i)) {                                      // Allocate space, sets spInit & SRD bits
+        tcb[i].pid = 0;
+        return false;
+    }
+
+    tcb[i].state = STATE_READY;
+    tcb[i].priority = priority;
+    tcb[i].currentPriority = priority;
+
+    strgcopy(tcb[i].name, name);                                    // Copy name
+
+    initThreadStack(i);                                             // Paint stack & make it look as though it has ran before
+
+    tcb[i].mutex = MAX_MUTEXES;                                     // Has no mutex
+    tcb[i].semaphore = MAX_SEMAPHORES;                              // Has no semaphore
+
+    tcb[i].cycles = 0;
+    tcb[i].cyclesSampled = 0;
+    tcb[i].releaseStart = 0;
+    for(j=0; j<CPU_WINDOW_SLOTS; j++)
+        tcb[i].cycleSlot[j] = 0;
+    tcb[i].cpuWindow = 0;
+    tcb[i].budget = 0;
+    tcb[i].overrun = false;
+    tcb[i].detached = false;
+
+    if(i >= taskCount)                                              // A reused record is already counted
+        taskCount = i + 1;
+    return true;
+}
+
+// SVC side of spawnThread. attr may be in flash or in the caller's memory
+void *taskSpawn(_fn fn, void *arg, const THREAD_ATTR *attr)
+{
+    uint8_t i = freeTcb();
+    void *pid;
+
+    if(i == MAX_TASKS || !fn)
+        return 0;
+    if((uint32_t)attr + sizeof(THREAD_ATTR) > FLASH_BASE + 0x40000                 // 256 KiB flash, all tasks read it
+       && !sramAccessible(tcb[taskCurrent].srd, (void *)attr, sizeof(THREAD_ATTR)))
+        return 0;
+    if(attr->name[sizeof(attr->name)-1] || attr->priority >= NUM_PRIORITIES
+       || attr->stackBytes < MIN_STACK_BYTES || attr->stackBytes > MAX_STACK_BYTES)
+        return 0;
+
+    pid = (void *)(SPAWN_PID + ++spawnSeq);
+    if(!taskCreate(i, pid, fn, arg, attr->name, attr->priority, attr->stackBytes))
+        return 0;
+    tcb[i].detached = attr->detached;
+    tcb[i].budget = attr->budget;
+    statsClear(i);                                                  // The record may have held another task
+    logKernel(LOG_SPAWNED, 3, i, (uint32_t)pid, taskCurrent, 0);
+    return pid;
+}
+
+// Allocate the stack of task (tcb size) and grant access to it, sets spInit & stackBase.
+// With STACK_GUARD the lowest sub-region of the allocation stays disabled in the SRD
+// mask, so an overflow raises an MPU fault instead of writing below the stack
+bool allocThreadStack(uint8_t task)
+{
+    uint16_t guard = 0;
+    void *top = 0;
+    void *baseAdd;
+
+    if(STACK_GUARD)
+        baseAdd = mallocGuardedStack(tcb[task].size, &guard, &top);
+    else
+        baseAdd = mallocFromHeap(tcb[task].size);
+
+    if(!baseAdd)
+        return false;
+    HCB_table[numAllocs-1].PID = tcb[task].pid;                     // Allocators append their entry last, owned by task not the caller
+
+    if(!STACK_GUARD)
+        top = (void *)((uint32_t)baseAdd + tcb[task].size);
+
+    tcb[task].guard = guard;
+    tcb[task].stackBase = (void *)((uint32_t)baseAdd + guard);      // Bottom of usable stack
+    tcb[task].spInit = top;                                         // Top of stack
+    tcb[task].sp = top;
+    addSramAccessWindow(&tcb[task].srd, tcb[task].stackBase, (uint32_t)top - (uint32_t)tcb[task].stackBase);
+
+    return true;
+}
+
+// True if address lies inside the guard sub-region below task's stack
+bool inStackGuard(uint8_t task, uint32_t address)
+{
+    uint32_t bottom = (uint32_t)tcb[task].stackBase;
+
+    return tcb[task].guard && address >= bottom - tcb[task].guard && address < bottom;
+}
+
+// True if p is the base of the heap block (guard included) behind any task's stack
+bool isStackBlock(void *p)
+{
+    uint8_t i;
+
+    for(i=0; i<MAX_TASKS; i++)
+        if(tcb[i].state > STATE_STOPPED && (uint32_t)tcb[i].stackBase - tcb[i].guard == (uint32_t)p)
+            return true;
+    return false;
+}
+
+// Paint the whole stack with STACK_PAINT, then build the initial exception frame at its top
+void initThreadStack(uint8_t task)
+{
+    uint32_t *p = tcb[task].stackBase;
+
+    while(p < (uint32_t *)tcb[task].spInit)
+        *(p++) = STACK_PAINT;
 
     // Make it look as though it has ran before
-    uint32_t *p = tcb[task].sp;
+    p = tcb[task].spInit;
     *(--p) = 0x01000000;                // XPSR -> Thumb bit set
-    *(--p) = (uint32_t)tcb[task].pid;   // PC   -> Function address
-    *(--p) = 0x0000DEAD;                // LR
+    *(--p) = (uint32_t)tcb[task].fn;    // PC   -> Function address
+    *(--p) = (uint32_t)threadExit;      // LR   -> where fn returns to
     *(--p) = 0x0000000C;                // R12
     *(--p) = 0x00000003;                // R3
     *(--p) = 0x00000002;                // R2
     *(--p) = 0x00000001;                // R1
-    *(--p) = 0x00000000;                // R0
+    *(--p) = (uint32_t)tcb[task].arg;   // R0   -> fn argument
     *(--p) = 0x00000004;                // R4
     *(--p) = 0x00000005;                // R5
     *(--p) = 0x00000006;                // R6
@@ -768,8 +1305,99 @@ void taskRestart(uint8_t task) {
     *(--p) = 0x0000000B;                // R11
     *(--p) = 0xFFFFFFFD;                // LR
     tcb[task].sp = (void *)p;
+}
+
+// Peak stack usage in bytes: scan up from the bottom for the first overwritten word
+uint32_t stackHighWater(uint8_t task)
+{
+    uint32_t *p = tcb[task].stackBase;
+
+    while(p < (uint32_t *)tcb[task].spInit && *p == STACK_PAINT)
+        p++;
+
+    return (uint32_t)tcb[task].spInit - (uint32_t)p;
+}
+
+// Copy tasks, allocations, semaphores & mutexes into one record, called from the SVC
+// handler so nothing can change part way through. Only the stack scan walks memory,
+// everything else is a straight copy the shell formats later.
+void fillSnapshot(SNAPSHOT *snap)
+{
+    uint32_t *psp = getPSP();                           // tcb sp is stale for the caller
+    uint8_t i, j, n;
+
+    snap->version = SNAPSHOT_VERSION;
+    snap->size = sizeof(SNAPSHOT);
+    snap->generation = ++snapGeneration;
+    snap->time = LOG_TIME();
+
+    for(i=0; i<taskCount; i++) {
+        SNAP_TASK *t = &snap->task[i];
+
+        t->pid = (uint32_t)tcb[i].pid;
+        t->cpuTicks = tcb[i].cpuWindow;
+        strgcopy(t->name, tcb[i].name);
+        t->cpu = tcb[i].cpuWindow / (CPU_WINDOW_CYCLES / FIX_PCT);  // %CPU, hundredths
+        t->state = tcb[i].state;
+        t->priority = tcb[i].priority;
+        t->sem = tcb[i].semaphore;
+        t->mtx = tcb[i].mutex;
+        t->budget = tcb[i].budget;
+        statsTask(i, t);
+
+        if(tcb[i].state > STATE_STOPPED) {              // Stopped tasks and free records have no stack
+            void *sp = (i == taskCurrent) ? psp : tcb[i].sp;
+            t->stackDepth = (uint32_t)tcb[i].spInit - (uint32_t)sp;
+            t->stackPeak = stackHighWater(i);
+            t->stackSize = (uint32_t)tcb[i].spInit - (uint32_t)tcb[i].stackBase;
+        }
+        else
+            t->stackDepth = t->stackPeak = t->stackSize = 0;
+    }
+    snap->taskCount = taskCount;
+
+    n = 0;
+    for(i=0; i<HCB_MAX_SIZE; i++) {                     // Only blocks in use, packed
+        if(HCB_table[i].size) {
+            snap->alloc[n].pid = (uint32_t)HCB_table[i].PID;
+            snap->alloc[n].baseAdd = (uint32_t)HCB_table[i].ptr;
+            snap->alloc[n].size = HCB_table[i].size;
+            snap->alloc[n].handle = HCB_table[i].handle;
+            snap->alloc[n].refCount = HCB_table[i].refCount;
+            n++;
+        }
+    }
+    snap->allocCount = n;
+
+    for(i=0; i<MAX_SEMAPHORES; i++) {
+        snap->sem[i].count = semaphores[i].count;
+        snap->sem[i].qSize = semaphores[i].queueSize;
+        for(j=0; j<MAX_SEMAPHORE_QUEUE_SIZE; j++)
+            snap->sem[i].q[j] = semaphores[i].processQueue[j];
+    }
+    snap->semCount = MAX_SEMAPHORES;
+
+    for(i=0; i<MAX_MUTEXES; i++) {
+        snap->mtx[i].lock = mutexes[i].lock;
+        snap->mtx[i].lockedBy = mutexes[i].lockedBy;
+        snap->mtx[i].qSize = mutexes[i].queueSize;
+        for(j=0; j<MAX_MUTEX_QUEUE_SIZE; j++)
+            snap->mtx[i].q[j] = mutexes[i].processQueue[j];
+    }
+    snap->mtxCount = MAX_MUTEXES;
+}
+
+// REQUIRED: Restart Thread
+void taskRestart(uint8_t task) {
+    if(!allocThreadStack(task))                                     // Reallocate memory & add its respective access
+        return;                                                     // No room, task stays stopped
+
+    initThreadStack(task);                                          // Paint stack & make it look as though it has ran before
 
     tcb[task].state = STATE_READY;                                  // Set state to READY
+    tcb[task].overrun = false;                                      // A fresh release
+    tcb[task].currentPriority = tcb[task].priority;
+    tcb[task].releaseStart = (uint32_t)tcb[task].cycles;            // Whatever it was doing when it was killed
 
     if(strgcmp(tcb[task].name, "ReadKeys"))                         // ReadKeys  is a special case, must increase count in its semaphore for it run properly
         semaphores[tcb[task].semaphore].count++;
@@ -778,6 +1406,14 @@ void taskRestart(uint8_t task) {
 
 // REQUIRED: Kernel Kill Function
 void taskKill(uint8_t task)
+{
+    logKernel(LOG_KILLED, 2, task, (uint32_t)tcb[task].pid, 0, 0);
+    taskEnd(task);
+}
+
+// Take task off every queue and free its memory, it is left STOPPED so it can be restarted.
+// A detached task's record is freed instead
+void taskEnd(uint8_t task)
 {
     uint8_t mutex = tcb[task].mutex;                        // Get mutex associated with task
     uint8_t sema = tcb[task].semaphore;                     // Get semaphore associated with task
@@ -810,23 +1446,28 @@ void taskKill(uint8_t task)
             if(semaphores[sema].queueSize) {                // check if there is a queue in semaphore
                 uint8_t *qS = semaphores[sema].processQueue;
 
-                for(i=0; i<MAX_MUTEX_QUEUE_SIZE-1; i++) {   // if task is in queue, dequeue it
-                    if(qS[i] == task) {
+                for(i=0; i<semaphores[sema].queueSize && qS[i] != task; i++);
+                if(i < semaphores[sema].queueSize) {        // if task is in queue, dequeue it
+                    semaphores[sema].queueSize--;
+                    for(; i<semaphores[sema].queueSize; i++)
                         qS[i] = qS[i+1];
-                        semaphores[sema].queueSize--;
-                    }
-                }
-                if(qS[i] == task) {
                     qS[i] = 0;
-                    semaphores[sema].queueSize--;
                 }
             }
         }
     }
 
+    logRelease(task);                                   // Its ring goes with its memory
+    detachTask(task);                                   // Leave shared regions, freed if last user
     freeToHeap(tcb[task].spInit);                       // Free memory
     tcb[task].srd = createNoSramAccessMask();           // Remove its access, update SRD bits
     tcb[task].state = STATE_STOPPED;                    // Set state to stopped
+
+    if(tcb[task].detached) {                            // Nothing left to restart, the record is free
+        tcb[task].state = STATE_INVALID;
+        tcb[task].pid = 0;
+        tcb[task].name[0] = 0;
+    }
 }
 
 //----------------------------------------------------
@@ -835,3 +1476,13 @@ void taskKill(uint8_t task)
 void *getPID() {
     return tcb[taskCurrent].pid;
 }
+
+// SRD mask of the task owning pid (needed when the heap moves its memory)
+uint64_t *getTaskSrd(void *pid) {
+    uint8_t i;
+    for(i=0; i<taskCount; i++) {
+        if(tcb[i].pid == pid && tcb[i].state != STATE_INVALID)
+            return &tcb[i].srd;
+    }
+    return 0;
+}
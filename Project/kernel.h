@@ -25,20 +25,55 @@
 // function pointer
 typedef void (*_fn)();
 
+// kernel state record (shell.h), trace event (trace.h), latency histogram (stats.h) and
+// profiler counts (prof.h)
+struct _SNAPSHOT;
+struct _TRACE_EVENT;
+struct _LAT_HIST;
+struct _PROF_DATA;
+
 // mutex
 #define MAX_MUTEXES 1
 #define MAX_MUTEX_QUEUE_SIZE 2
 #define resource 0
 
 // semaphore
-#define MAX_SEMAPHORES 3
-#define MAX_SEMAPHORE_QUEUE_SIZE 2
+#define MAX_SEMAPHORES 6
+#define MAX_SEMAPHORE_QUEUE_SIZE MAX_TASKS   // a task waits on one at a time, so no queue overflows
 #define keyPressed 0
 #define keyReleased 1
 #define flashReq 2
+#define uartTxFree 3
+#define uartRxReady 4
+#define uartDmaDone 5
 
 // tasks
 #define MAX_TASKS 12
+#define STACK_GUARD true            // reserve lowest sub-region of each stack as no-access guard
+
+// task states
+#define STATE_INVALID           0 // no task
+#define STATE_STOPPED           1 // stopped, all memory freed
+#define STATE_READY             2 // has run, can resume at any time
+#define STATE_DELAYED           3 // has run, but now awaiting timer
+#define STATE_BLOCKED_MUTEX     4 // has run, but now blocked by mutex
+#define STATE_BLOCKED_SEMAPHORE 5 // has run, but now blocked by semaphore
+
+// spawnThread attributes, in flash or in the caller's memory
+#define MIN_STACK_BYTES     256     // initial frame (17 words) and room for a few calls
+#define MAX_STACK_BYTES     0x7000  // the whole 28 KiB heap
+
+typedef struct _THREAD_ATTR {
+    char name[16];                  // terminated within the 16 bytes
+    uint32_t stackBytes;            // MIN_STACK_BYTES to MAX_STACK_BYTES
+    uint8_t priority;               // 0=highest
+    bool detached;                  // tcb record freed when it ends, no restart
+    uint16_t budget;                // us, see setThreadBudget (0 none)
+} THREAD_ATTR;
+
+// CPU%: DWT cycles per task, moving average over CPU_WINDOW_SLOTS samples of CPU_SAMPLE_MS
+#define CPU_SAMPLE_MS       250
+#define CPU_WINDOW_SLOTS    4
 
 //-----------------------------------------------------------------------------
 // Subroutines
@@ -51,6 +86,9 @@ void initRtos(void);
 void startRtos(void);
 
 bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes);
+bool setThreadBudget(_fn fn, uint16_t us);
+void *spawnThread(_fn fn, void *arg, const THREAD_ATTR *attr);
+void threadExit(void);
 void restartThread(_fn fn);
 void stopThread(_fn fn);
 void setThreadPriority(_fn fn, uint8_t priority);
@@ -61,17 +99,59 @@ void lock(int8_t mutex);
 void unlock(int8_t mutex);
 void wait(int8_t semaphore);
 void post(int8_t semaphore);
+uint16_t _writeUart0(const char *str);
+int16_t _readUart0(void);
+bool _kbhitUart0(void);
+int8_t _writeUart0Dma(const void *data, uint16_t len);
+bool _uart0DmaBusy(void);
+bool _logRegister(void *ring);
+void _logFlush(void);
+uint8_t _readUart0Bulk(char *buf, uint8_t max);
+bool _snapshot(struct _SNAPSHOT *snap);
+uint16_t _traceRead(struct _TRACE_EVENT *buf, uint16_t max);
+bool _latRead(struct _LAT_HIST *buf, bool reset);
+void _profControl(uint8_t op);
+bool _profRead(struct _PROF_DATA *buf);
 
 void systickIsr(void);
 void pendSvIsr(void);
 void svCallIsr(void);
-
+void svCall(uint8_t svcNum);
+void chargeCycles(void);
+void checkBudget(bool blocking);
+void switchOut(void);
+void sampleCpu(void);
+
+uint8_t freeTcb(void);
+bool taskCreate(uint8_t i, void *pid, _fn fn, void *arg, const char name[], uint8_t priority, uint32_t stackBytes);
+void *taskSpawn(_fn fn, void *arg, const THREAD_ATTR *attr);
+bool allocThreadStack(uint8_t task);
+bool inStackGuard(uint8_t task, uint32_t address);
+bool isStackBlock(void *p);
+void initThreadStack(uint8_t task);
+uint32_t stackHighWater(uint8_t task);
+void fillSnapshot(struct _SNAPSHOT *snap);
 void taskRestart(uint8_t task);
 void taskKill(uint8_t task);
+void taskEnd(uint8_t task);
 void taskUnlock(uint8_t mutex, uint8_t task);
+void taskBlock(uint8_t semaphore);
+void taskPost(uint8_t semaphore);
+void taskPostAll(uint8_t semaphore);
 
 void *_mallocFromHeap(uint32_t size);
+void *_reallocFromHeap(void *pMemory, uint32_t size);
+void *_alignedMallocFromHeap(uint32_t size, uint32_t alignment);
+void *_createSharedRegion(uint16_t key, uint32_t size);
+void *_attachSharedRegion(uint16_t key);
+void _detachSharedRegion(void *pMemory);
+uint8_t _mallocHandle(uint32_t size);
+void *_lockHandle(uint8_t handle);
+void _unlockHandle(uint8_t handle);
+void _freeHandle(uint8_t handle);
+void _compactHeap(void);
 uint32_t _pidof(char *name);
 void *getPID();
+uint64_t *getTaskSrd(void *pid);
 
 #endif
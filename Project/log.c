@@ -0,0 +1,249 @@
+// Binary deferred logging
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Tasks log a format id plus raw argument words into a ring in their own memory, which
+// costs a few stores. When the idle task asks (SVC), the kernel copies complete records out
+// of every registered ring and queues each one on the UART TX ring as a COBS frame
+// (0x00 before and after, last byte is a checksum making the payload sum to 0).
+// tools/logdecode.c turns the frames back into text using logfmt.h
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "log.h"
+#include "kernel.h"
+#include "uart0.h"
+#include "mm.h"
+
+#define LOG_FRAME_MAX   (((2+LOG_MAX_ARGS)*4 + 1) + 3)  // payload + checksum, COBS overhead, 2 delimiters
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+LOG_RING kernelLog = {0, 0, LOG_KERNEL_WORDS-1, 0, 0, 0};   // data set by initLog
+LOG_RING **logRings = 0;                    // registered ring of each task (by tcb index)
+uint8_t logNext = 0;                        // task ring to drain first next time (fairness)
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Timestamp timer and the kernel's log memory, call from main(). The kernel ring's data and
+// the ring table share one kernel heap block, kernel RAM below the heap has no room for them
+bool initLog(void)
+{
+    uint32_t *p;
+    uint8_t i;
+
+    p = mallocKernel((LOG_KERNEL_WORDS + MAX_TASKS) * 4);
+    if(!p)
+        return false;
+    kernelLog.data = p;
+    logRings = (LOG_RING **)(p + LOG_KERNEL_WORDS);
+    for(i=0; i<MAX_TASKS; i++)
+        logRings[i] = 0;
+
+    SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R2;
+    _delay_cycles(3);
+    TIMER2_CTL_R &= ~TIMER_CTL_TAEN;
+    TIMER2_CFG_R = TIMER_CFG_32_BIT_TIMER;
+    TIMER2_TAMR_R = TIMER_TAMR_TAMR_PERIOD | TIMER_TAMR_TACDIR;    // up count, free running
+    TIMER2_TAILR_R = 0xFFFFFFFF;
+    TIMER2_IMR_R = 0;
+    TIMER2_CTL_R |= TIMER_CTL_TAEN;
+    return true;
+}
+
+// Append a record, drops it (and counts) if the ring is full. Safe from the owning task only
+void logWrite(LOG_RING *ring, uint8_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    uint16_t head, mask;
+
+    if(!ring)
+        return;
+
+    head = ring->head;
+    mask = ring->mask;
+    if((uint16_t)(mask + 1 - (uint16_t)(head - ring->tail)) < 2 + nargs) {
+        ring->dropped++;
+        return;
+    }
+
+    ring->data[head++ & mask] = LOG_HEADER(id, nargs);
+    ring->data[head++ & mask] = LOG_TIME();
+    if(nargs > 0) ring->data[head++ & mask] = a0;
+    if(nargs > 1) ring->data[head++ & mask] = a1;
+    if(nargs > 2) ring->data[head++ & mask] = a2;
+    if(nargs > 3) ring->data[head++ & mask] = a3;
+    ring->head = head;                                  // publish, the record is complete
+}
+
+// Kernel and ISR records (privileged, all at priority 0 so there is one producer at a time)
+void logKernel(uint8_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    if(kernelLog.data)                                  // Dropped before initLog
+        logWrite(&kernelLog, id, nargs, a0, a1, a2, a3);
+}
+
+// Task side: set up a ring over data (words, power of 2) in the task's own memory, e.g. its
+// stack, and register it. A task has one ring, attaching again replaces it
+bool logAttach(LOG_RING *ring, uint32_t *data, uint16_t words)
+{
+    if(words < 8 || (words & (words - 1)))
+        return false;
+
+    ring->head = ring->tail = 0;
+    ring->mask = words - 1;
+    ring->dropped = ring->reported = 0;
+    ring->data = data;
+    return _logRegister(ring);
+}
+
+// Task side: ring of words taken from the task's heap
+LOG_RING *logOpen(uint16_t words)
+{
+    LOG_RING *ring = _mallocFromHeap(sizeof(LOG_RING) + words*4);
+
+    if(!ring || !logAttach(ring, (uint32_t *)(ring + 1), words))
+        return 0;
+    return ring;
+}
+
+// Ring header and data both inside memory enabled by srd, the kernel writes the tail and
+// must not do so on a task's behalf anywhere the task itself couldn't
+bool logRingAccessible(uint64_t srd, LOG_RING *ring)
+{
+    return sramAccessible(srd, ring, sizeof(LOG_RING)) &&
+           !((ring->mask + 1) & ring->mask) &&
+           sramAccessible(srd, ring->data, ((uint32_t)ring->mask + 1)*4);
+}
+
+// SVC side of logAttach, ring already checked with logRingAccessible
+void logRegister(uint8_t task, LOG_RING *ring)
+{
+    logRings[task] = ring;
+}
+
+// Task killed or ring memory gone
+void logRelease(uint8_t task)
+{
+    logRings[task] = 0;
+}
+
+LOG_RING *logRingOf(uint8_t task)
+{
+    return logRings[task];
+}
+
+// Move complete records of ring into buf (at most words), tagging them with task.
+// Returns words written
+uint16_t logCopyRing(LOG_RING *ring, uint8_t task, uint32_t *buf, uint16_t words)
+{
+    uint16_t tail = ring->tail, head = ring->head, mask = ring->mask;
+    uint16_t n = 0, len, i;
+    uint32_t header;
+
+    if(ring->dropped != ring->reported && words >= 3) {
+        buf[n++] = LOG_HEADER(LOG_DROPPED, 1) | task;
+        buf[n++] = LOG_TIME();
+        buf[n++] = (uint16_t)(ring->dropped - ring->reported);
+        ring->reported = ring->dropped;
+    }
+
+    while(tail != head) {
+        header = ring->data[tail & mask];
+        len = 2 + LOG_NARGS(header);
+        if(n + len > words)
+            break;
+        buf[n++] = (header & 0xFFFFFF00) | task;
+        for(i=1; i<len; i++)
+            buf[n++] = ring->data[(tail + i) & mask];
+        tail += len;
+    }
+    ring->tail = tail;
+    return n;
+}
+
+// Kernel ring first, then task rings round robin
+uint16_t logCollect(uint32_t *buf, uint16_t words)
+{
+    uint16_t n;
+    uint8_t i, task;
+
+    n = logCopyRing(&kernelLog, LOG_KERNEL_TASK, buf, words);
+    for(i=0; i<MAX_TASKS && n < words; i++) {
+        task = (logNext + i) % MAX_TASKS;
+        if(logRings[task])
+            n += logCopyRing(logRings[task], task, buf + n, words - n);
+    }
+    logNext = (logNext + 1) % MAX_TASKS;
+    return n;
+}
+
+// Consistent overhead byte stuffing: dst gets len + 1 + len/254 bytes with no 0x00
+uint16_t cobsEncode(const uint8_t *src, uint16_t len, uint8_t *dst)
+{
+    uint16_t out = 1, code = 0, i;
+    uint8_t run = 1;
+
+    for(i=0; i<len; i++) {
+        if(src[i] == 0) {
+            dst[code] = run;
+            code = out++;
+            run = 1;
+        }
+        else {
+            dst[out++] = src[i];
+            if(++run == 0xFF) {
+                dst[code] = run;
+                code = out++;
+                run = 1;
+            }
+        }
+    }
+    dst[code] = run;
+    return out;
+}
+
+// SVC side of logFlush: encode pending records as frames straight into the UART TX ring,
+// only while the ring has room for them, so the caller never blocks
+void logFlushRecords(void)
+{
+    uint32_t buf[2+LOG_MAX_ARGS];
+    uint8_t frame[LOG_FRAME_MAX];
+    uint8_t payload[(2+LOG_MAX_ARGS)*4 + 1];
+    uint16_t n, i, j, len, out;
+    uint8_t sum;
+
+    while(txBufferFree() >= 3*LOG_FRAME_MAX) {                 // buf holds up to 3 short records
+        n = logCollect(buf, 2+LOG_MAX_ARGS);
+        if(!n)
+            break;
+
+        for(i=0; i<n; i+=len) {
+            len = 2 + LOG_NARGS(buf[i]);
+            sum = 0;
+            for(j=0; j<len*4; j++) {                            // little endian words
+                payload[j] = buf[i + j/4] >> (8*(j%4));
+                sum += payload[j];
+            }
+            payload[j] = -sum;
+            frame[0] = 0;                                       // also ends any text before it
+            out = 1 + cobsEncode(payload, len*4 + 1, &frame[1]);
+            frame[out++] = 0;
+            writeTxBytes(frame, out);
+        }
+    }
+}
@@ -0,0 +1,75 @@
+// Binary deferred logging
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Format ids, see logfmt.h
+#define LOG_FMT(id, fmt) id,
+enum {
+#include "logfmt.h"
+    LOG_FMT_COUNT
+};
+#undef LOG_FMT
+
+#define LOG_MAX_ARGS        4
+#define LOG_KERNEL_WORDS    64                  // kernel/ISR ring, in a kernel heap block
+#define LOG_KERNEL_TASK     0xFF                // task field of records from the kernel ring
+
+// Record in a ring: header word (id << 24 | nargs << 16 | task), timestamp, args.
+// The producer writes task 0, the kernel fills it in while draining
+#define LOG_HEADER(id, nargs)   ((uint32_t)(id) << 24 | (uint32_t)(nargs) << 16)
+#define LOG_ID(h)               ((h) >> 24)
+#define LOG_NARGS(h)            (((h) >> 16) & 0xF)
+#define LOG_TASK(h)             ((h) & 0xFF)
+
+// Timestamp: TIMER2 free running up count at 40 MHz (wraps every 107 s),
+// readable by tasks since it is in the peripheral region
+#define LOG_TIME()              TIMER2_TAV_R
+
+// Single producer (owning task) / single consumer (kernel drain) ring, no locks
+typedef struct _LOG_RING {
+    volatile uint16_t head;     // written by the producer only
+    volatile uint16_t tail;     // written by the kernel drain only
+    uint16_t mask;              // size in words - 1, size is a power of 2
+    volatile uint16_t dropped;  // records lost to a full ring (producer)
+    uint16_t reported;          // dropped count already sent (kernel)
+    uint32_t *data;
+} LOG_RING;
+
+#define LOG0(r, id)                 logWrite(r, id, 0, 0, 0, 0, 0)
+#define LOG1(r, id, a)              logWrite(r, id, 1, a, 0, 0, 0)
+#define LOG2(r, id, a, b)           logWrite(r, id, 2, a, b, 0, 0)
+#define LOG3(r, id, a, b, c)        logWrite(r, id, 3, a, b, c, 0)
+#define LOG4(r, id, a, b, c, d)     logWrite(r, id, 4, a, b, c, d)
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+bool initLog(void);
+void logWrite(LOG_RING *ring, uint8_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+void logKernel(uint8_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+bool logAttach(LOG_RING *ring, uint32_t *data, uint16_t words);
+LOG_RING *logOpen(uint16_t words);
+
+bool logRingAccessible(uint64_t srd, LOG_RING *ring);
+void logRegister(uint8_t task, LOG_RING *ring);
+void logRelease(uint8_t task);
+LOG_RING *logRingOf(uint8_t task);
+uint16_t logCollect(uint32_t *buf, uint16_t words);
+
+uint16_t cobsEncode(const uint8_t *src, uint16_t len, uint8_t *dst);
+void logFlushRecords(void);
+
+#endif
@@ -0,0 +1,16 @@
+// Log format table
+// J Losh
+
+// X-macro list of every log record format. The firmware only stores the id (position in
+// this list) and the raw argument words; tools/logdecode.c includes this same file to turn
+// records back into text. Append new entries at the end so old captures still decode.
+// Arguments are 32-bit words, use %u, %d, %x or %08x only (at most LOG_MAX_ARGS).
+
+LOG_FMT(LOG_DROPPED,    "%u records dropped (ring full)")
+LOG_FMT(LOG_BOOT,       "RTOS started, %u tasks")
+LOG_FMT(LOG_MPU_FAULT,  "MPU fault pid=0x%x addr=0x%08x pc=0x%08x mflags=0x%x")
+LOG_FMT(LOG_KILLED,     "task %u (pid 0x%x) killed")
+LOG_FMT(LOG_SHELL_CMD,  "shell command, %u fields")
+LOG_FMT(LOG_OVERRUN,    "task %u (pid 0x%x) over budget, %u cycles since release")
+LOG_FMT(LOG_SPAWNED,    "task %u (pid 0x%x) spawned by task %u")
+LOG_FMT(LOG_EXITED,     "task %u (pid 0x%x) exited")
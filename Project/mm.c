@@ -14,7 +14,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
-#include "tm4c123gh6pm.h"
+#include "hal.h"
 #include "mm.h"
 #include "kernel.h"
 
@@ -22,8 +22,10 @@
 // Subroutines
 //-----------------------------------------------------------------------------
 
+HCB HCB_table[HCB_MAX_SIZE+1] = {};
 uint64_t subRegInUse = 0;
 uint8_t numAllocs = 0;
+HANDLE handles[MAX_HANDLES] = {};
 
 // REQUIRED: add your malloc code here and update the SRD bits for the current thread
 void *mallocFromHeap(uint32_t size_in_bytes)
@@ -137,41 +139,235 @@ void *mallocFromHeap(uint32_t size_in_bytes)
         }
     }
 
-    if(best_idx == -1)                                                  // Unable to find space
-        return 0;   
+    if(best_idx == -1) {                                                // Unable to find space
+        if(compactHeap())                                               // If relocatable blocks were moved, free space may now be contiguous
+            return mallocFromHeap(size_in_bytes);
+        return 0;
+    }
+
+    return commitAlloc(best_idx, subregs_to_use, best_fit);
+}
+
+// Mark sub-regions as used and store meta data of allocation in HCB_table
+void *commitAlloc(int8_t idx, uint8_t subregs_to_use, uint16_t size) {
+    uint8_t i;
+
+    if(numAllocs >= HCB_MAX_SIZE)                                       // No room for meta data
+        return 0;
 
     for(i=0; i<subregs_to_use; i++)
-        subRegInUse |= 1ULL << (best_idx + i);                          // Update mask. 1ULL safety for shifting beyond 32 bits
+        subRegInUse |= 1ULL << (idx + i);                               // Update mask. 1ULL safety for shifting beyond 32 bits
 
-    if(numAllocs < HCB_MAX_SIZE) {                                      // Store meta data of allocation
-        HCB_table[numAllocs].ptr = getAddress(best_idx);
-        HCB_table[numAllocs].SP = (void *)((uint32_t)getAddress(best_idx) + best_fit);
-        HCB_table[numAllocs].size = best_fit;
-        HCB_table[numAllocs].PID = getPID();
+    HCB_table[numAllocs].ptr = getAddress(idx);
+    HCB_table[numAllocs].SP = (void *)((uint32_t)getAddress(idx) + size);
+    HCB_table[numAllocs].size = size;
+    HCB_table[numAllocs].PID = getPID();
+    HCB_table[numAllocs].handle = NO_HANDLE;
+    HCB_table[numAllocs].refCount = 0;
+    HCB_table[numAllocs].users = 0;
+    HCB_table[numAllocs].key = 0;
 
-        numAllocs++;
+    numAllocs++;
 
-        return HCB_table[numAllocs-1].ptr;                              // Retunr based address
-    }
+    return HCB_table[numAllocs-1].ptr;                                  // Retunr based address
+}
+
+// Allocate a stack of at least size_in_bytes plus one extra sub-region at the bottom to be
+// used as guard. Returns base of the allocation, guard size and top of stack through pointers
+void *mallocGuardedStack(uint32_t size_in_bytes, uint16_t *guard, void **top)
+{
+    void *baseAdd;
+    uint16_t extra;
+    int8_t sr;
+
+    for(extra=0x200; extra<=0x400; extra+=0x200) {                      // Guard is a 512 or a 1024 sub-region
+        baseAdd = mallocFromHeap(size_in_bytes + extra);
+        if(!baseAdd)
+            return 0;
 
+        sr = find_SR(baseAdd);
+        *guard = ((sr >= 8 && sr <= 15) || (sr >= 32 && sr <= 39)) ? 0x400 : 0x200;
+        if(HCB_table[numAllocs-1].size - *guard >= size_in_bytes) {     // Landed where usable part is big enough
+            *top = HCB_table[numAllocs-1].SP;
+            return baseAdd;
+        }
+
+        freeTask(numAllocs-1);                                          // 512 extra landed in a 1024 region, retry
+        numAllocs--;
+    }
     return 0;
 }
 
+// Allocate a block for kernel data. PID 0 is no task, so no task SRD ever opens it and
+// freeTask never frees it, only privileged code can touch it
+void *mallocKernel(uint32_t size_in_bytes)
+{
+    void *baseAdd;
+
+    baseAdd = mallocFromHeap(size_in_bytes);
+    if(baseAdd)
+        HCB_table[numAllocs-1].PID = 0;                                 // mallocFromHeap appends its entry last
+    return baseAdd;
+}
+
+// mallocKernel for a block whose base address is a multiple of alignment (power of 2)
+void *alignedMallocKernel(uint32_t size_in_bytes, uint32_t alignment)
+{
+    void *baseAdd;
+
+    baseAdd = alignedMallocFromHeap(size_in_bytes, alignment);
+    if(baseAdd)
+        HCB_table[numAllocs-1].PID = 0;                                 // commitAlloc appends its entry last
+    return baseAdd;
+}
+
+// Allocate a block whose base address is a multiple of alignment (power of 2)
+void *alignedMallocFromHeap(uint32_t size_in_bytes, uint32_t alignment)
+{
+    uint8_t r, j, n;
+    uint16_t subreg_size;
+    int8_t best_idx = -1;
+    uint16_t best_fit = 0x2000+1;
+    uint8_t subregs_to_use = 0;
+
+    if(alignment == 0 || (alignment & (alignment - 1)))                 // Must be a power of 2
+        return 0;
+
+    if(alignment <= 0x200)                                              // Every sub-region is at least 512 aligned
+        return mallocFromHeap(size_in_bytes);
+
+    if(size_in_bytes > 0x2000 || size_in_bytes == 0x0) return 0;        // 8kiB cap
+
+    for(r=0; r<5; r++) {                                                // Best fit over all regions, aligned starts only
+        subreg_size = (r == 1 || r == 4) ? 1024 : 512;
+        n = (size_in_bytes + subreg_size - 1)/subreg_size;
+        if(n > 8 || n*subreg_size >= best_fit)
+            continue;
+
+        for(j=r*8; j+n <= r*8+8; j++) {                                 // stay within region
+            if((uint32_t)getAddress(j) & (alignment - 1))
+                continue;
+            if(subregs_free(j, n)) {
+                best_fit = n*subreg_size;
+                best_idx = j;
+                subregs_to_use = n;
+                break;
+            }
+        }
+    }
+
+    if(best_idx == -1) {
+        if(compactHeap())
+            return alignedMallocFromHeap(size_in_bytes, alignment);
+        return 0;
+    }
+
+    return commitAlloc(best_idx, subregs_to_use, best_fit);
+}
+
+// Grow (or keep) an allocation of the current task. Grows in place into adjacent free
+// sub-regions of the same region when possible, otherwise moves the data to a new block.
+// Owner SRD bits and HCB entry are updated. Returns new base address, 0 on failure (block untouched).
+// The TASK_REALLOC SVC refuses stack blocks before calling, see isStackBlock
+void *reallocFromHeap(void *pMemory, uint32_t size_in_bytes)
+{
+    int8_t idx, newIdx;
+    uint8_t i, start, used, needed, h;
+    uint16_t subreg_size;
+    uint64_t *srd;
+    void *newAdd;
+    uint32_t *from, *to;
+    uint32_t words;
+
+    if(!pMemory) {                                                      // Plain malloc, owner gets its window here too
+        newAdd = mallocFromHeap(size_in_bytes);
+        srd = getTaskSrd(getPID());
+        if(newAdd && srd)
+            addSramAccessWindow(srd, newAdd, size_in_bytes);
+        return newAdd;
+    }
+
+    idx = findHCB(pMemory);
+    if(idx < 0 || HCB_table[idx].PID != getPID())                       // Only the owner may resize
+        return 0;
+    if(HCB_table[idx].refCount)                                         // Other users hold windows to shared regions
+        return 0;
+    if(size_in_bytes > 0x2000 || size_in_bytes == 0x0)
+        return 0;
+    if(size_in_bytes <= HCB_table[idx].size)                            // Already big enough
+        return pMemory;
+
+    srd = getTaskSrd(HCB_table[idx].PID);
+    start = find_SR(pMemory);
+    used = countSubregs(start, HCB_table[idx].size);
+
+    if(!((start == 7 || start == 15 || start == 31) && used == 2)) {    // Region edge blocks can't grow in place
+        subreg_size = ((start >= 8 && start <= 15) || (start >= 32 && start <= 39)) ? 1024 : 512;
+        needed = (size_in_bytes + subreg_size - 1)/subreg_size;
+
+        if(start + needed <= (start/8)*8 + 8 && subregs_free(start + used, needed - used)) {
+            for(i=used; i<needed; i++)
+                subRegInUse |= 1ULL << (start + i);
+
+            HCB_table[idx].size = needed*subreg_size;
+            HCB_table[idx].SP = (void *)((uint32_t)pMemory + HCB_table[idx].size);
+            if(srd)
+                addSramAccessWindow(srd, pMemory, HCB_table[idx].size);
+            return pMemory;
+        }
+    }
+
+    h = HCB_table[idx].handle;
+    if(h != NO_HANDLE)                                                  // Don't let compaction move it under us
+        handles[h].lockCount++;
+
+    newAdd = mallocFromHeap(size_in_bytes);
+
+    if(h != NO_HANDLE)
+        handles[h].lockCount--;
+
+    if(!newAdd)
+        return 0;
+
+    newIdx = numAllocs-1;                                               // mallocFromHeap appends its entry last
+    from = (uint32_t *)pMemory;
+    to = (uint32_t *)newAdd;
+    words = HCB_table[idx].size/4;
+    while(words--)
+        *(to++) = *(from++);
+
+    HCB_table[newIdx].handle = h;                                       // Handle follows the data
+    HCB_table[idx].handle = NO_HANDLE;
+    if(h != NO_HANDLE)
+        handles[h].ptr = newAdd;
+
+    if(srd) {
+        removeSramAccessWindow(srd, pMemory, HCB_table[idx].size);
+        addSramAccessWindow(srd, newAdd, HCB_table[newIdx].size);
+    }
+
+    freeTask(idx);
+    numAllocs--;
+
+    return newAdd;
+}
+
 // REQUIRED: add your free code here and update the SRD bits for the current thread
 void freeToHeap(void *pMemory)
 {
-    uint8_t i, j;
+    uint8_t i;
+    int8_t j;
+    void *pid;
+
     for(i=0; i<numAllocs; i++) {
         if(HCB_table[i].SP == pMemory) {                                // Find task thru matching SP passed with the one stored in HCB_table
-            for(j=0; j<numAllocs; j++) {                                // Once found, check if this task has made more allocations via PID, 
-                if(i != j && HCB_table[i].PID == HCB_table[j].PID) {
-                    freeTask(j);                                        // If so free said allocations
+            pid = HCB_table[i].PID;
+            for(j=numAllocs-1; j>=0; j--) {                             // Once found, free every allocation of this task via PID.
+                if(HCB_table[j].PID == pid && !HCB_table[j].refCount) { // Backwards so shifting entries doesn't skip any.
+                    freeTask(j);                                        // Shared regions are only freed by their last user
                     numAllocs--;
                 }
             }
-
-            freeTask(i);                                                // Free task allocation
-            numAllocs--;
             return;
         }
     }
@@ -179,32 +375,289 @@ void freeToHeap(void *pMemory)
 
 void freeTask(uint8_t task) {
     uint8_t i, start;
-    uint16_t subreg_size = 0;
     uint16_t subregs_used = 0;
 
     start = find_SR(HCB_table[task].ptr);                                               // Find starting sub-region
-
-    if((start == 7 || start == 15 || start == 31 ) && HCB_table[task].size == 0x600) {
-        subregs_used = 2;
-    }
-    else {
-        if((start >= 8 && start <= 15) || (start >=32 && start <=39)) 
-            subreg_size = 1024;
-        else 
-            subreg_size = 512;
-
-        subregs_used = (HCB_table[task].size + subreg_size - 1)/subreg_size;            // Determine num of sub-regions used
-    }
+    subregs_used = countSubregs(start, HCB_table[task].size);                           // Determine num of sub-regions used
 
     for(i=0; i<subregs_used; i++)
         subRegInUse &= ~(1ULL << (start + i));                                          // Update mask
 
+    if(HCB_table[task].handle != NO_HANDLE)                                             // Relocatable block? release its handle
+        handles[HCB_table[task].handle].inUse = false;
+
     for(i=task; i<numAllocs; i++) {                                                     // Shift entreis in HCB_table
         HCB_table[i].ptr = HCB_table[i+1].ptr;
         HCB_table[i].SP = HCB_table[i+1].SP;
         HCB_table[i].size = HCB_table[i+1].size;
         HCB_table[i].PID = HCB_table[i+1].PID;
+        HCB_table[i].handle = HCB_table[i+1].handle;
+        HCB_table[i].refCount = HCB_table[i+1].refCount;
+        HCB_table[i].users = HCB_table[i+1].users;
+        HCB_table[i].key = HCB_table[i+1].key;
+    }
+}
+
+// SHARED REGIONS
+
+// Allocate a region other tasks can attach to with key. Caller (task) is its first user
+void *createSharedRegion(uint16_t key, uint32_t size_in_bytes, uint8_t task) {
+    void *baseAdd;
+    uint8_t i;
+
+    for(i=0; i<numAllocs; i++) {                                                        // Key must be unique
+        if(HCB_table[i].refCount && HCB_table[i].key == key)
+            return 0;
+    }
+
+    baseAdd = mallocFromHeap(size_in_bytes);
+    if(!baseAdd)
+        return 0;
+
+    HCB_table[numAllocs-1].refCount = 1;                                                // mallocFromHeap appends its entry last
+    HCB_table[numAllocs-1].users = 1 << task;
+    HCB_table[numAllocs-1].key = key;
+    return baseAdd;
+}
+
+// Add task as user of the shared region with key. Returns its base address, 0 if not found
+void *attachSharedRegion(uint16_t key, uint8_t task) {
+    uint8_t i;
+
+    for(i=0; i<numAllocs; i++) {
+        if(HCB_table[i].refCount && HCB_table[i].key == key) {
+            if(!(HCB_table[i].users & (1 << task))) {
+                HCB_table[i].users |= 1 << task;
+                HCB_table[i].refCount++;
+            }
+            return HCB_table[i].ptr;
+        }
+    }
+    return 0;
+}
+
+// Remove task as user of the shared region at pMemory, memory is freed when the last user detaches.
+// Returns size of the region so the caller can revoke access, 0 if task wasn't attached
+uint16_t detachSharedRegion(void *pMemory, uint8_t task) {
+    int8_t idx = findHCB(pMemory);
+    uint16_t size;
+
+    if(idx < 0 || !(HCB_table[idx].users & (1 << task)))
+        return 0;
+
+    size = HCB_table[idx].size;
+    HCB_table[idx].users &= ~(1 << task);
+    HCB_table[idx].refCount--;
+
+    if(!HCB_table[idx].refCount) {
+        freeTask(idx);
+        numAllocs--;
+    }
+    return size;
+}
+
+// Detach a task being killed from every shared region it uses
+void detachTask(uint8_t task) {
+    int8_t i;
+
+    for(i=numAllocs-1; i>=0; i--) {                                                     // Backwards, detaching may free entries
+        if(HCB_table[i].users & (1 << task))
+            detachSharedRegion(HCB_table[i].ptr, task);
+    }
+}
+
+// Size of the allocation starting at pMemory, 0 if none
+uint16_t allocSize(void *pMemory) {
+    int8_t idx = findHCB(pMemory);
+
+    return (idx < 0) ? 0 : HCB_table[idx].size;
+}
+
+// RELOCATABLE HANDLES
+
+// Allocate a block the kernel is allowed to move. Returns a handle, or NO_HANDLE
+uint8_t mallocHandle(uint32_t size_in_bytes) {
+    uint8_t h = 0;
+    void *baseAdd;
+    uint64_t *srd;
+
+    while(h < MAX_HANDLES && handles[h].inUse) h++;                                     // Find free handle
+    if(h == MAX_HANDLES)
+        return NO_HANDLE;
+
+    baseAdd = mallocFromHeap(size_in_bytes);
+    if(!baseAdd)
+        return NO_HANDLE;
+
+    HCB_table[numAllocs-1].handle = h;                                                  // mallocFromHeap appends its entry last
+    handles[h].ptr = baseAdd;
+    handles[h].lockCount = 0;
+    handles[h].inUse = true;
+
+    srd = getTaskSrd(getPID());
+    if(srd)
+        addSramAccessWindow(srd, baseAdd, HCB_table[numAllocs-1].size);                 // Give owner access
+    return h;
+}
+
+// Pin the block and return its current address. Only the owner may lock it
+void *lockHandle(uint8_t handle) {
+    int8_t idx;
+
+    if(handle >= MAX_HANDLES || !handles[handle].inUse)
+        return 0;
+
+    idx = findHCB(handles[handle].ptr);
+    if(idx < 0 || HCB_table[idx].PID != getPID())
+        return 0;
+
+    if(handles[handle].lockCount < 0xFF)
+        handles[handle].lockCount++;
+
+    return handles[handle].ptr;
+}
+
+void unlockHandle(uint8_t handle) {
+    if(handle < MAX_HANDLES && handles[handle].inUse && handles[handle].lockCount)
+        handles[handle].lockCount--;
+}
+
+void freeHandle(uint8_t handle) {
+    int8_t idx;
+    uint64_t *srd;
+
+    if(handle >= MAX_HANDLES || !handles[handle].inUse)
+        return;
+
+    idx = findHCB(handles[handle].ptr);
+    if(idx < 0 || HCB_table[idx].PID != getPID())
+        return;
+
+    srd = getTaskSrd(HCB_table[idx].PID);
+    if(srd)
+        removeSramAccessWindow(srd, HCB_table[idx].ptr, HCB_table[idx].size);
+    freeTask(idx);                                                                      // Also releases the handle
+    numAllocs--;
+}
+
+// Free heap bytes, and through largest (if not 0) the biggest block mallocFromHeap could
+// return from one free run: at most 8 sub-regions, R2 and R3 count as one run of 512s
+uint32_t freeHeapRuns(uint32_t *largest) {
+    uint8_t r, s;
+    uint16_t subreg_size;
+    uint32_t run = 0;
+    uint32_t block;
+    uint32_t biggest = 0;
+    uint32_t total = 0;
+
+    for(r=0; r<5; r++) {                                                                // mallocFromHeap's 512 searches
+        subreg_size = (r == 1 || r == 4) ? 1024 : 512;                                  // run over 16-31, so a block can
+        if(r != 3)                                                                      // span R2 and R3
+            run = 0;
+        for(s=r*8; s<r*8+8; s++) {
+            if(subRegInUse & (1ULL << s)) {
+                run = 0;
+                continue;
+            }
+            run += subreg_size;
+            total += subreg_size;
+            block = (run < 8*subreg_size) ? run : 8*subreg_size;                        // 4 KiB or 8 KiB cap
+            if(block > biggest)
+                biggest = block;
+        }
+    }
+
+    if(largest)
+        *largest = biggest;
+    return total;
+}
+
+// Largest block mallocFromHeap can still hand out, in bytes (the 1536 region edge blocks aside)
+uint32_t largestFreeBlock(void) {
+    uint32_t largest;
+
+    freeHeapRuns(&largest);
+    return largest;
+}
+
+// Percentage of free heap that lies outside the largest free block (0 = not fragmented)
+uint8_t heapFragmentation(void) {
+    uint32_t largest;
+    uint32_t total;
+
+    total = freeHeapRuns(&largest);
+    if(total == 0)
+        return 0;
+
+    return 100 - (largest * 100)/total;
+}
+
+// Slide unlocked relocatable blocks down within their region so free sub-regions
+// coalesce at the top. Owner SRD bits, HCB and handle table follow the block.
+// Returns the number of blocks moved
+uint8_t compactHeap(void) {
+    uint8_t r, s, n, k;
+    uint8_t dest;
+    uint8_t moved = 0;
+    int8_t idx;
+    uint8_t h;
+    uint64_t *srd;
+    uint32_t *from, *to;
+    uint32_t words;
+
+    for(r=0; r<5; r++) {
+        dest = r*8;                                                                     // Lowest sub-region a block could slide to
+        s = r*8;
+
+        while(s < r*8+8) {
+            if(!(subRegInUse & (1ULL << s))) {                                          // Free, keep looking
+                s++;
+                continue;
+            }
+
+            idx = findHCB(getAddress(s));
+            if(idx < 0) {                                                               // Tail of a block spanning from the previous region
+                s++;
+                dest = s;
+                continue;
+            }
+
+            n = countSubregs(s, HCB_table[idx].size);
+            h = HCB_table[idx].handle;
+
+            if(h != NO_HANDLE && handles[h].lockCount == 0 && dest < s && s+n <= r*8+8) {
+                from = (uint32_t *)HCB_table[idx].ptr;
+                to = (uint32_t *)getAddress(dest);
+                words = HCB_table[idx].size/4;
+                for(k=0; k<n; k++)                                                      // Move mask first, dest < s so
+                    subRegInUse &= ~(1ULL << (s + k));                                  // ranges may overlap
+                for(k=0; k<n; k++)
+                    subRegInUse |= 1ULL << (dest + k);
+
+                while(words--)                                                          // Ascending copy is safe for overlap since to < from
+                    *(to++) = *(from++);
+
+                srd = getTaskSrd(HCB_table[idx].PID);
+                if(srd) {                                                               // Revoke old window before granting the new one,
+                    removeSramAccessWindow(srd, HCB_table[idx].ptr, HCB_table[idx].size);   // they may share sub-regions
+                    addSramAccessWindow(srd, getAddress(dest), HCB_table[idx].size);
+                }
+
+                HCB_table[idx].ptr = getAddress(dest);
+                HCB_table[idx].SP = (void *)((uint32_t)HCB_table[idx].ptr + HCB_table[idx].size);
+                handles[h].ptr = HCB_table[idx].ptr;
+                moved++;
+
+                dest += n;
+            }
+            else {
+                dest = s + n;                                                           // Pinned block, nothing may slide past it
+            }
+            s += n;
+        }
     }
+
+    return moved;
 }
 
 // HELPER FUNCTIONS
@@ -219,6 +672,63 @@ bool subregs_free(int8_t idx, uint8_t subregs_to_use) {
     return 1;
 }
 
+// Find HCB entry of the allocation starting at ptr, -1 if none
+int8_t findHCB(void *ptr) {
+    uint8_t i;
+    for(i=0; i<numAllocs; i++) {
+        if(HCB_table[i].ptr == ptr)
+            return i;
+    }
+    return -1;
+}
+
+// Number of sub-regions an allocation of size bytes starting at sub-region start occupies
+uint8_t countSubregs(int8_t start, uint16_t size) {
+    uint16_t subreg_size = 0;
+
+    if((start == 7 || start == 15 || start == 31 ) && size == 0x600)               // Region edge 512 + 1024
+        return 2;
+
+    if((start >= 8 && start <= 15) || (start >=32 && start <=39))
+        subreg_size = 1024;
+    else
+        subreg_size = 512;
+
+    return (size + subreg_size - 1)/subreg_size;
+}
+
+// True if [ptr, ptr+size) lies in the heap and every sub-region it touches is enabled in srd
+bool sramAccessible(uint64_t srd, void *ptr, uint32_t size) {
+    uint32_t add = (uint32_t)ptr;
+    int8_t i;
+
+    if(size == 0 || add < BASE_ADD || add + size > R4_8k + 0x2000 || add + size < add)
+        return false;
+
+    for(i=find_SR(ptr); i<=find_SR((void *)(add + size - 1)); i++)
+        if(srd & (1ULL << i))
+            return false;
+
+    return true;
+}
+
+// Bytes from ptr up to the first sub-region srd closes (or the end of the heap), 0 if
+// the caller can not read ptr itself. Bounds walks over data of unknown length
+uint32_t sramAccessibleLength(uint64_t srd, const void *ptr) {
+    uint32_t add = (uint32_t)ptr;
+    int8_t i;
+
+    if(add < BASE_ADD || add >= R4_8k + 0x2000)
+        return 0;
+
+    i = find_SR((void *)ptr);
+    if(srd & (1ULL << i))
+        return 0;
+    while(i < 40 && !(srd & (1ULL << i)))
+        i++;
+    return (i < 40 ? (uint32_t)getAddress(i) : R4_8k + 0x2000) - add;
+}
+
 // Calculate base address based on starting subregion 
 void *getAddress(int8_t subReg) {
     uint16_t size = 0;
@@ -368,6 +878,28 @@ void addSramAccessWindow(uint64_t *srdBitMask, uint32_t *baseAdd, uint32_t size_
     //applySramAccessMask(*srdBitMask);
 }
 
+void removeSramAccessWindow(uint64_t *srdBitMask, uint32_t *baseAdd, uint32_t size_in_bytes)
+{
+    uint8_t i = 0;
+    uint8_t start = find_SR(baseAdd);                                               // Find strating subregion index
+    uint8_t end = start;
+    uint16_t subreg_size = 0;
+    uint16_t removed_size = 0;
+
+    while(removed_size < size_in_bytes) {                                           // determined nymber of subregions to revoke
+        if((end >= 8 && end <= 15) || (end >=32 && end <=39))
+            subreg_size = 1024;
+        else
+            subreg_size = 512;
+
+        removed_size += subreg_size;
+        end++;
+    }
+
+    for(i=0; i<(end-start); i++)                                                    // Disable the same subregions addSramAccessWindow enabled
+        *srdBitMask |= 1ULL << (start + i);
+}
+
 void applySramAccessMask(uint64_t srdBitMask)
 {
 //    uint8_t i;
@@ -15,13 +15,30 @@
 
 #define HCB_MAX_SIZE 19
 
+// Relocatable handles
+#define MAX_HANDLES     8
+#define NO_HANDLE       0xFF
+#define FRAG_THRESHOLD  50          // % of free heap outside the largest free block before idle compacts
+
 typedef struct _HCB {
     void *ptr;
     void *SP;
     uint16_t size;      // Max size 8kiB
     void* PID;
+    uint8_t handle;     // Index into handle table if relocatable, else NO_HANDLE
+    uint8_t refCount;   // Number of tasks attached to a shared region (0 = private)
+    uint16_t users;     // Bit per tcb index of tasks attached to a shared region
+    uint16_t key;       // Key other tasks attach to a shared region with
 } HCB;
-HCB HCB_table[HCB_MAX_SIZE+1] = {};
+extern HCB HCB_table[HCB_MAX_SIZE+1];
+extern uint8_t numAllocs;
+extern uint64_t subRegInUse;
+
+typedef struct _HANDLE {
+    void *ptr;          // Current base address, updated when compaction moves the block
+    uint8_t lockCount;  // Block is pinned while locked
+    bool inUse;
+} HANDLE;
 
 #define FLASH_BASE  0x00000000          // 0x0000.0000 - 0x0003.FFFF    2^18
 #define PERIP_BASE  0x40000000          // 0x4000.0000 - 0x43FF.FFFF    2^26
@@ -42,16 +59,41 @@ HCB HCB_table[HCB_MAX_SIZE+1] = {};
 bool subregs_free(int8_t idx, uint8_t subregs_to_use);
 void *getAddress(int8_t SR);
 int8_t find_SR(void *ptr);
+int8_t findHCB(void *ptr);
+uint8_t countSubregs(int8_t start, uint16_t size);
 
 void *mallocFromHeap(uint32_t size_in_bytes);
+void *commitAlloc(int8_t idx, uint8_t subregs_to_use, uint16_t size);
+void *mallocGuardedStack(uint32_t size_in_bytes, uint16_t *guard, void **top);
+void *mallocKernel(uint32_t size_in_bytes);
+void *alignedMallocFromHeap(uint32_t size_in_bytes, uint32_t alignment);
+void *alignedMallocKernel(uint32_t size_in_bytes, uint32_t alignment);
+void *reallocFromHeap(void *pMemory, uint32_t size_in_bytes);
 void freeToHeap(void *pMemory);
 void freeTask(uint8_t task);
 
+uint8_t mallocHandle(uint32_t size_in_bytes);
+void *lockHandle(uint8_t handle);
+void unlockHandle(uint8_t handle);
+void freeHandle(uint8_t handle);
+void *createSharedRegion(uint16_t key, uint32_t size_in_bytes, uint8_t task);
+void *attachSharedRegion(uint16_t key, uint8_t task);
+uint16_t detachSharedRegion(void *pMemory, uint8_t task);
+void detachTask(uint8_t task);
+uint16_t allocSize(void *pMemory);
+bool sramAccessible(uint64_t srd, void *ptr, uint32_t size);
+uint32_t sramAccessibleLength(uint64_t srd, const void *ptr);
+uint32_t freeHeapRuns(uint32_t *largest);
+uint32_t largestFreeBlock(void);
+uint8_t heapFragmentation(void);
+uint8_t compactHeap(void);
+
 void allowFlashAccess(void);
 void allowPeripheralAccess(void);
 void setupSramAccess(void);
 uint64_t createNoSramAccessMask(void);
 void addSramAccessWindow(uint64_t *srdBitMask, uint32_t *baseAdd, uint32_t size_in_bytes);
+void removeSramAccessWindow(uint64_t *srdBitMask, uint32_t *baseAdd, uint32_t size_in_bytes);
 void applySramAccessMask(uint64_t srdBitMask);
 
 #endif
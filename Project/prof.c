@@ -0,0 +1,105 @@
+// Sampling profiler
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Hardware configuration:
+// WTIMER2A periodic, set up by rtos.c and started by profControl
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "asp.h"
+#include "mm.h"
+#include "prof.h"
+
+PROF_SLOT *profSlot = 0;                    // kernel heap block, see initProf
+uint32_t profSamples = 0;
+uint32_t profMissed = 0;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Called once before the RTOS starts, after every task stack has been allocated. The table
+// fills one 512 byte sub-region, kernel RAM below the heap has no room for it
+bool initProf(void)
+{
+    uint8_t i;
+
+    profSlot = mallocKernel(sizeof(PROF_SLOT) * PROF_SLOTS);
+    if(!profSlot)
+        return false;
+
+    for(i=0; i<PROF_SLOTS; i++) {
+        profSlot[i].pc = 0;
+        profSlot[i].count = 0;
+    }
+    return true;
+}
+
+// SVC side of the prof command, the handlers it races with can not preempt it
+void profControl(uint8_t op)
+{
+    uint8_t i;
+
+    switch(op) {
+        case PROF_ON:
+            WTIMER2_CTL_R |= TIMER_CTL_TAEN;
+            break;
+        case PROF_OFF:
+            WTIMER2_CTL_R &= ~TIMER_CTL_TAEN;
+            break;
+        case PROF_RESET:
+            for(i=0; i<PROF_SLOTS; i++) {
+                profSlot[i].pc = 0;
+                profSlot[i].count = 0;
+            }
+            profSamples = 0;
+            profMissed = 0;
+            break;
+    }
+}
+
+// SVC side of _profRead
+void profCopy(PROF_DATA *buf)
+{
+    uint8_t i;
+
+    buf->samples = profSamples;
+    buf->missed = profMissed;
+    buf->on = (WTIMER2_CTL_R & TIMER_CTL_TAEN) != 0;
+    for(i=0; i<PROF_SLOTS; i++)
+        buf->slot[i] = profSlot[i];
+}
+
+// Count the stacked PC of the interrupted task. Tasks run on the PSP and no handler can
+// be preempted by this one, so the frame the PSP points at is always a task's
+void wTimer2Isr(void)
+{
+    uint32_t pc = getPSP()[6];
+    uint8_t i, n;
+
+    profSamples++;
+    i = ((pc >> 1) ^ (pc >> 7)) & (PROF_SLOTS-1);
+    for(n=0; n<PROF_PROBES; n++, i=(i+1) & (PROF_SLOTS-1)) {
+        if(profSlot[i].pc == pc || !profSlot[i].pc) {
+            profSlot[i].pc = pc;
+            profSlot[i].count++;
+            break;
+        }
+    }
+    if(n == PROF_PROBES)
+        profMissed++;
+
+    WTIMER2_ICR_R = TIMER_ICR_TATOCINT;     // Clear interrupt
+}
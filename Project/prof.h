@@ -0,0 +1,58 @@
+// Sampling profiler
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// WTIMER2A interrupts every PROF_PERIOD cycles while the profiler is on and counts the PC
+// the interrupted task will resume at. Handlers all run at priority 0, so a sample that
+// comes due in one is taken when it returns: kernel time is charged to the task it returns
+// to. Off, the timer is stopped and costs nothing.
+//
+// prof DUMP prints, for tools/profsym.c:
+//   P,<samples>,<missed>,<rate Hz>
+//   C,<pc>,<count>            one line per PC seen, pc is hex with a 0x prefix
+// missed counts samples whose PC found no free slot, raise PROF_SLOTS if it is large
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PROF_SLOTS      64                  // power of 2, 8 bytes each in a kernel heap block
+#define PROF_PROBES     8                   // slots tried before a sample is missed
+#define PROF_PERIOD     9973                // cycles, prime so it does not lock to the 1 ms tick
+#define PROF_HZ         (40000000 / PROF_PERIOD)
+
+// profControl ops
+#define PROF_OFF        0
+#define PROF_ON         1
+#define PROF_RESET      2
+
+typedef struct _PROF_SLOT {
+    uint32_t pc;                            // 0 is a free slot
+    uint32_t count;
+} PROF_SLOT;
+
+typedef struct _PROF_DATA {
+    uint32_t samples;
+    uint32_t missed;
+    bool on;
+    PROF_SLOT slot[PROF_SLOTS];
+} PROF_DATA;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+bool initProf(void);
+void profControl(uint8_t op);
+void profCopy(PROF_DATA *buf);
+void wTimer2Isr(void);
+
+#endif
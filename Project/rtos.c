@@ -20,7 +20,7 @@
 // UART Interface:
 //   U0TX (PA1) and U0RX (PA0) are connected to the 2nd controller
 //   The USB on the 2nd controller enumerates to an ICDI interface and a virtual COM port
-//   Configured to 115,200 baud, 8N1
+//   Configured to 115,200 baud, 8N1 (UART_BAUD, or AUTO_BAUD)
 // Memory Protection Unit (MPU):
 //   Region to control access to flash, peripherals, and bitbanded areas
 //   4 or more regions to allow SRAM access (RW or none for task)
@@ -39,6 +39,14 @@
 #include "faults.h"
 #include "tasks.h"
 #include "shell.h"
+#include "log.h"
+#include "bench.h"
+#include "heapbench.h"
+#include "prof.h"
+#include "stats.h"
+
+#define UART_BAUD   115200              // 921600 (HSE, +640 ppm) for trace/log streaming
+#define AUTO_BAUD   false               // true: wait for 'U' or Enter and use the terminal's rate
 
 //-----------------------------------------------------------------------------
 // Main
@@ -56,30 +64,48 @@ int main(void)
     allowPeripheralAccess();
     setupSramAccess();
     initRtos();
+    ok = initLog();
+
+    // Setup UART0 baud rate, or match the terminal's rate from its first keystroke
+    if(AUTO_BAUD)
+        autoBaudUart0(40e6);
+    else
+        setUart0BaudRate(UART_BAUD, 40e6);
 
-    // Setup UART0 baud rate
-    setUart0BaudRate(115200, 40e6);
+#if BENCH
+    // Allocator traces first, before any task stack is on the heap, see heapbench.c
+    heapBench();
+#endif
 
     // Initialize mutexes and semaphores
     initMutex(resource);
     initSemaphore(keyPressed, 1);
     initSemaphore(keyReleased, 0);
     initSemaphore(flashReq, 5);
+    initSemaphore(uartTxFree, 0);
+    initSemaphore(uartRxReady, 0);
+    initSemaphore(uartDmaDone, 0);
+
+    // uDMA for bulk UART output
+    ok &= initUart0Dma();
 
     // Add required idle process at lowest priority
-    ok =  createThread(idle, "Idle", 15, 512);
+    ok &= createThread(idle, "Idle", 15, 512);
     //ok &= createThread(idle2, "Idle2", 15, 512);
 
-    // Add other processes
-    ok &= createThread(lengthyFn, "LengthyFn", 12, 1024);
-    ok &= createThread(flash4Hz, "Flash4Hz", 8, 512);
-    ok &= createThread(oneshot, "OneShot", 4, 1536);
-    ok &= createThread(readKeys, "ReadKeys", 12, 1024);
-    ok &= createThread(debounce, "Debounce", 12, 1024);
-    ok &= createThread(important, "Important", 0, 1024);
-    ok &= createThread(uncooperative, "Uncoop", 12, 1024);
-    ok &= createThread(errant, "Errant", 12, 512);
-    ok &= createThread(shell, "Shell", 12, 4096);
+#if BENCH
+    // Benchmark firmware, see bench.c
+    initBench();
+    ok &= createThread(bench, "Bench", 8, 1024);
+    ok &= createThread(benchYield, "BenchYield", 8, 512);
+    ok &= createThread(benchPong, "BenchPong", 6, 512);
+#else
+    // Add other processes, see tasktable.h (check it with tools/rta.c after changing it)
+#define TASK(fn, name, priority, stack, period, wcet, deadline, mutex, cs) \
+    ok &= createThread(fn, name, priority, stack) && setThreadBudget(fn, wcet);
+#include "tasktable.h"
+#undef TASK
+#endif
 
     // TODO: Add code to implement a periodic timer and ISR
     SYSCTL_RCGCWTIMER_R |= SYSCTL_RCGCWTIMER_R1;
@@ -91,6 +117,22 @@ int main(void)
     NVIC_EN3_R = 1 << (INT_WTIMER1A-16-96);
     WTIMER1_CTL_R |= TIMER_CTL_TAEN;
 
+    // Sampling profiler timer, left stopped until prof ON (see prof.h)
+    SYSCTL_RCGCWTIMER_R |= SYSCTL_RCGCWTIMER_R2;
+    _delay_cycles(3);
+    WTIMER2_CTL_R &= ~TIMER_CTL_TAEN;
+    WTIMER2_TAMR_R = TIMER_TAMR_TAMR_PERIOD;
+    WTIMER2_TAILR_R = PROF_PERIOD;
+    WTIMER2_IMR_R = TIMER_IMR_TATOIM;
+    NVIC_EN3_R = 1 << (INT_WTIMER2A-16-96);
+
+    // Kernel statistics and profiler table, after the stacks so the blocks take spare sub-regions
+    if (ok && !(initStats() && initProf()))
+    {
+        putsUart0("No heap left for the kernel statistics or profiler, not starting\n");
+        ok = false;
+    }
+
     // Start up RTOS
     if (ok)
         startRtos(); // never returns
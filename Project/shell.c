@@ -20,9 +20,27 @@
 #include "uart0.h"
 #include "asp.h"
 #include "mm.h"
+#include "log.h"
+#include "fmt.h"
+#include "statrec.h"
+#include "trace.h"
+#include "stats.h"
+#include "prof.h"
 
 // REQUIRED: Add header files here for your strings functions, ...
 
+// Buffers of the dump commands, one heap block the shell takes at start instead of up to
+// 2.4 KiB of its stack per command. Commands run one at a time, so they share it
+typedef struct _SHELL_SCRATCH {
+    SNAPSHOT snap;
+    UART_BLOCK out;
+    union {
+        TRACE_EVENT events[TRACE_EVENTS];
+        LAT_HIST hist[LAT_COUNT];
+        PROF_DATA prof;
+    } data;
+} SHELL_SCRATCH;
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -31,6 +49,13 @@
 void shell(void)
 {
     COMMAND_DATA data;
+    LINE_EDITOR editor;
+    LOG_RING shellLog;
+    uint32_t logData[32];
+    SHELL_SCRATCH *scratch = _mallocFromHeap(sizeof(SHELL_SCRATCH));
+
+    logAttach(&shellLog, logData, 32);
+    initLineEditor(&editor);
 
     // On startup clear putty screen and place cursors top-left
     putsUart0(CLEAR_PUTTY);
@@ -39,180 +64,374 @@ void shell(void)
     putsUart0(GREEN_TXT);
     putsUart0("user@: ");
     putsUart0(DFLT_TXT);
+    if(!scratch)
+        putsUart0("No heap for the shell buffers, commands that print tables are off\n");
 
 
     while(true) {
-        if(kbhitUart0()) {
-
-            bool valid = false;
-            getsUart0(&data);
-            parseFields(&data);
-
-            // Reboots the microcontroller. This will be implemented as part of the mini project
-            if(isCommand(&data, "reboot", 0)) {
-                putsUart0(BLUE_TXT);
-                putsUart0("user@: ");
-                reboot();
-                valid = true;
-            }
+        const SHELL_CMD *cmd;
+        bool valid = false;
+        getsUart0(&editor, &data);
+        parseFields(&data);
+        LOG1(&shellLog, LOG_SHELL_CMD, data.fieldCount);
+
+        // User input new line
+        if(data.buffer[0] == 0) valid = true;
+
+        // Table lookup, else run the selected program in the background
+        else if((cmd = findCommand(getFieldString(&data, 0))) != 0) {
+            if(data.fieldCount-1 >= cmd->minArgs)
+                valid = cmd->handler(&data, scratch);
+        }
+        else {
+            char *name = getFieldString(&data, 0);
+            valid = runProc(name);
+        }
 
-            //Displays the process (thread) status.
-            else if(isCommand(&data, "ps", 0)) {
-                ps();
-                valid = true;
-            }
+        if(!valid) {
+            putsUart0(RED_TXT);
+            putsUart0("Invalid Command\n\n");
+        }
 
-            // Displays the inter-process (thread) communication status.
-            else if(isCommand(&data, "ipcs", 0)) {
-                ipcs();
-                valid = true;
-            }
+        // Print in green "user@: " and go back to normal
+        putsUart0(GREEN_TXT);
+        putsUart0("user@: ");
+        putsUart0(DFLT_TXT);
+    }
+}
 
-            // Kills the process (thread) with the matching PID
-            else if(isCommand(&data, "kill", 1)) {
-                uint32_t pid = getFieldInteger(&data, 1);
-                kill(pid);
-                valid = true;
-            }
+//-----------------------------------------------------------------------------
+// Command table
+//-----------------------------------------------------------------------------
 
-            // Kills the thread based on the process name
-            else if(isCommand(&data, "pkill", 1)) {
-                char *name = getFieldString(&data, 1);
-                pkill(name);
-                valid = true;
-            }
+// Reboots the microcontroller
+bool cmdReboot(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    putsUart0(BLUE_TXT);
+    putsUart0("user@: ");
+    reboot();
+    return true;
+}
 
-            //Turns priority inheritance ON or OFF.
-            else if(isCommand(&data, "pi", 1)) {
-                char *str1 = getFieldString(&data, 1);
-
-                if(strgcmp(str1, "ON")) {
-                    pi(true);
-                    valid = true;
-                }
-                else if(strgcmp(str1, "OFF")) {
-                    pi(false);
-                    valid = true;
-                }
-                else {
-                    valid = false;
-                }
-            }
+// Displays the process (thread) status, ps -v for scheduling statistics
+bool cmdPs(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    uint8_t view = PS_STATUS;
+
+    if(data->fieldCount > 1) {
+        if(strgcmp(getFieldString(data, 1), "-v") || strgcmp(getFieldString(data, 1), "-V"))
+            view = PS_SCHED;
+        else if(strgcmp(getFieldString(data, 1), "-w") || strgcmp(getFieldString(data, 1), "-W"))
+            view = PS_EXEC;
+        else
+            return false;
+    }
 
-            //Turns preemption on or off.
-            else if(isCommand(&data, "preempt", 1)) {
-                char *str1 = getFieldString(&data, 1);
-
-                if(strgcmp(str1, "ON")) {
-                    preempt(true);
-                    valid = true;
-                }
-                else if(strgcmp(str1, "OFF")) {
-                    preempt(false);
-                    valid = true;
-                }
-                else {
-                    valid = false;
-                }
-            }
+    ps(scratch, view);
+    return true;
+}
 
-            //Selected priority or round-robin scheduling. PRIO|RR
-            else if(isCommand(&data, "sched", 1)) {
-                char *str1 = getFieldString(&data, 1);
-
-                if(strgcmp(str1, "PRIO")) {
-                    sched(true);
-                    valid = true;
-                }
-                else if(strgcmp(str1, "RR")) {
-                    sched(false);
-                    valid = true;
-                }
-                else {
-                    valid = false;
-                }
-            }
+// Displays the inter-process (thread) communication status
+bool cmdIpcs(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    ipcs(scratch);
+    return true;
+}
 
-            // Displays the PID of the process (thread).
-            else if(isCommand(&data, "pidof", 1)) {
-                char *name = getFieldString(&data, 1);
-                pidof(name);
-                valid = true;
-            }
+// Kills the process (thread) with the matching PID
+bool cmdKill(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    kill(getFieldInteger(data, 1));
+    return true;
+}
 
-            //meminfo
-            else if(isCommand(&data, "meminfo", 0)) {
-                meminfo();
-                valid = true;
-            }
+// Kills the thread based on the process name
+bool cmdPkill(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    pkill(getFieldString(data, 1));
+    return true;
+}
 
-            // clears putty & places cursor at top
-            else if(isCommand(&data, "clear", 0)) {
-                putsUart0(CLEAR_PUTTY);
-                putsUart0(HOME_POS);
-                valid = true;
-            }
+// Turns priority inheritance ON or OFF
+bool cmdPi(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    char *str1 = getFieldString(data, 1);
+
+    if(strgcmp(str1, "ON"))
+        pi(true);
+    else if(strgcmp(str1, "OFF"))
+        pi(false);
+    else
+        return false;
+    return true;
+}
 
-            // User input new line
-            else if(data.buffer[0] == 0) valid = true;
+// Turns preemption ON or OFF
+bool cmdPreempt(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    char *str1 = getFieldString(data, 1);
 
-            // Runs the selected program in the background.
-            else {
-                char *name = getFieldString(&data, 0);
-                valid = runProc(name);
-            }
+    if(strgcmp(str1, "ON"))
+        preempt(true);
+    else if(strgcmp(str1, "OFF"))
+        preempt(false);
+    else
+        return false;
+    return true;
+}
 
-            if(!valid) {
-                putsUart0(RED_TXT);
-                putsUart0("Invalid Command\n\n");
-            }
+// Selects priority or round-robin scheduling
+bool cmdSched(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    char *str1 = getFieldString(data, 1);
 
-            // Print in green "user@: " and go back to normal
-            putsUart0(GREEN_TXT);
-            putsUart0("user@: ");
-            putsUart0(DFLT_TXT);
-        }
+    if(strgcmp(str1, "PRIO"))
+        sched(true);
+    else if(strgcmp(str1, "RR"))
+        sched(false);
+    else
+        return false;
+    return true;
+}
+
+// Displays the PID of the process (thread)
+bool cmdPidof(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    pidof(getFieldString(data, 1));
+    return true;
+}
+
+bool cmdMeminfo(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    meminfo(scratch);
+    return true;
+}
+
+// Machine-readable status, stat CSV|BIN [ms], with ms repeats until a key is pressed
+bool cmdStat(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    char *str1 = getFieldString(data, 1);
+    uint32_t period = 0;
+    bool binary;
+
+    if(strgcmp(str1, "CSV"))
+        binary = false;
+    else if(strgcmp(str1, "BIN"))
+        binary = true;
+    else
+        return false;
+
+    if(data->fieldCount > 2)
+        period = getFieldInteger(data, 2);
+
+    telemetry(scratch, binary, period);
+    return true;
+}
+
+// Dumps the kernel event trace for tools/trace2json
+bool cmdTrace(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    trace(scratch);
+    return true;
+}
+
+// Latency histograms, lat RESET clears them after printing (worst cases are kept)
+bool cmdLat(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    bool reset = false;
+
+    if(data->fieldCount > 1) {
+        if(!strgcmp(getFieldString(data, 1), "RESET"))
+            return false;
+        reset = true;
+    }
+
+    lat(scratch, reset);
+    return true;
+}
+
+// Sampling profiler, prof ON|OFF|RESET, prof DUMP prints the counts for tools/profsym
+bool cmdProf(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    char *str1 = getFieldString(data, 1);
+
+    if(strgcmp(str1, "ON"))
+        _profControl(PROF_ON);
+    else if(strgcmp(str1, "OFF"))
+        _profControl(PROF_OFF);
+    else if(strgcmp(str1, "RESET"))
+        _profControl(PROF_RESET);
+    else if(strgcmp(str1, "DUMP"))
+        profDump(scratch);
+    else
+        return false;
+    return true;
+}
+
+// Clears putty & places cursor at top
+bool cmdClear(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    putsUart0(CLEAR_PUTTY);
+    putsUart0(HOME_POS);
+    return true;
+}
+
+bool cmdHelp(COMMAND_DATA *data, SHELL_SCRATCH *scratch) {
+    help(scratch);
+    return true;
+}
+
+// Sorted by name (strgorder), const so it stays in flash where the shell task can read it.
+// To add a command, add a handler above and insert its row in order
+const SHELL_CMD commands[] = {
+    {"clear",   0, cmdClear,    "clear the terminal"},
+    {"help",    0, cmdHelp,     "list commands"},
+    {"ipcs",    0, cmdIpcs,     "semaphore and mutex status"},
+    {"kill",    1, cmdKill,     "kill <pid>"},
+    {"lat",     0, cmdLat,      "lat [RESET], latency histograms (cycles)"},
+    {"meminfo", 0, cmdMeminfo,  "heap allocations"},
+    {"pi",      1, cmdPi,       "pi ON|OFF, priority inheritance"},
+    {"pidof",   1, cmdPidof,    "pidof <name>"},
+    {"pkill",   1, cmdPkill,    "pkill <name>"},
+    {"preempt", 1, cmdPreempt,  "preempt ON|OFF"},
+    {"prof",    1, cmdProf,     "prof ON|OFF|DUMP|RESET, sampling profiler"},
+    {"ps",      0, cmdPs,       "ps [-v|-w], process status (-v scheduling, -w per release)"},
+    {"reboot",  0, cmdReboot,   "reset the microcontroller"},
+    {"sched",   1, cmdSched,    "sched PRIO|RR"},
+    {"stat",    1, cmdStat,     "stat CSV|BIN [ms], records for tools"},
+    {"trace",   0, cmdTrace,    "dump the kernel event trace (binary)"},
+};
+
+#define COMMAND_COUNT (sizeof(commands)/sizeof(commands[0]))
+
+// Binary search of the command table, 0 if name is not a command
+const SHELL_CMD *findCommand(const char name[]) {
+    int8_t lo = 0, hi = COMMAND_COUNT - 1, mid, order;
+
+    while(lo <= hi) {
+        mid = (lo + hi) / 2;
+        order = strgorder(name, commands[mid].name);
+        if(order == 0)
+            return &commands[mid];
+        if(order < 0)
+            hi = mid - 1;
+        else
+            lo = mid + 1;
+    }
+    return 0;
+}
 
-        yield();
+// Generated from the command table, <name> runs a program in the background
+void help(SHELL_SCRATCH *scratch) {
+    UART_BLOCK *out = &scratch->out;
+    uint8_t i, len;
+
+    if(!scratch)
+        return;
+
+    openBlock(out);
+    putsBlock(out, "\n");
+    for(i=0; i<COMMAND_COUNT; i++) {
+        putsBlock(out, (char *)commands[i].name);
+        for(len=0; commands[i].name[len]; len++);
+        putsBlock(out, len < 8 ? "\t\t" : "\t");
+        putsBlock(out, (char *)commands[i].help);
+        putsBlock(out, "\n");
     }
+    putsBlock(out, "<name>\t\trun (restart) the task called name\n\n");
+    closeBlock(out);
 }
 
 void reboot() {
     __asm(" SVC #8 ");
 }
 
-void ps() {
-    PS ps[MAX_TASKS] = {0};
-    __asm(" SVC #9 ");
+void ps(SHELL_SCRATCH *scratch, uint8_t view) {
+    SNAPSHOT *snap = &scratch->snap;
+    UART_BLOCK *out = &scratch->out;
+    uint32_t counts[7];
+    uint8_t i;
+
+    if(!scratch || !_snapshot(snap))
+        return;
+
+    openBlock(out);
+    if(view == PS_EXEC) {                               // release (wake) to blocking call
+        putsBlock(out, "\nProcess\t\tPID#\t Budget Releases      Min     Mean      Max  Overrun\n");
+        putsBlock(out, "-----------------------------------------------------------------------------------\n");
+        for(i=0; i<snap->taskCount; i++) {
+            SNAP_TASK *t = &snap->task[i];
+
+            if(t->state == STATE_INVALID)               // Free record, a detached task ended
+                continue;
+
+            counts[0] = t->budget;
+            counts[1] = t->releases;
+            counts[2] = t->execMin;
+            counts[3] = t->execMean;
+            counts[4] = t->execMax;
+            counts[5] = t->overruns;
+            printPSv(out, t->name, t->pid, counts, 6);
+        }
+        putsBlock(out, "-----------------------------------------------------------------------------------\n");
+        putsBlock(out, "Budget in us (0 none), Min to Max in cycles of CPU per release\n\n");
+        closeBlock(out);
+        return;
+    }
+    if(view == PS_SCHED) {                              // ms and cycles since power up
+        putsBlock(out, "\nProcess\t\tPID#\t    Vol    Invol    Ready    Delay    Mutex      Sem  MaxResp\n");
+        putsBlock(out, "-----------------------------------------------------------------------------------\n");
+        for(i=0; i<snap->taskCount; i++) {
+            SNAP_TASK *t = &snap->task[i];
+
+            if(t->state == STATE_INVALID)               // Free record, a detached task ended
+                continue;
+
+            counts[0] = t->voluntary;
+            counts[1] = t->involuntary;
+            counts[2] = t->readyMs;
+            counts[3] = t->delayedMs;
+            counts[4] = t->mutexMs;
+            counts[5] = t->semaphoreMs;
+            counts[6] = t->maxResponse;
+            printPSv(out, t->name, t->pid, counts, 7);
+        }
+        putsBlock(out, "-----------------------------------------------------------------------------------\n");
+        putsBlock(out, "Ready to Sem in ms, MaxResp (READY to RUNNING) in cycles\n\n");
+        closeBlock(out);
+        return;
+    }
+
+    putsBlock(out, "\nProcess\t\tPID#\t %CPU\t SP\tPeak\tFree\t  State       S    M\n");
+    putsBlock(out, "-------------------------------------------------------------------------------\n");
+    for(i=0; i<snap->taskCount; i++) {
+        SNAP_TASK *t = &snap->task[i];
 
-    uint8_t i = 0;
-    putsUart0("\nProcess\t\tPID#\t %CPU\t  State       S    M\n");
-    putsUart0("------------------------------------------------------\n");
-    while(ps[i].PID) {
-        printPS(ps[i].name, ps[i].PID, ps[i].cpu, ps[i].state, ps[i].sem, ps[i].mtx);
-        i++;
+        if(t->state == STATE_INVALID)                   // Free record, a detached task ended
+            continue;
+        printPS(out, t->name, t->pid, t->cpu, t->stackDepth, t->stackPeak, t->stackSize - t->stackPeak,
+                t->state, t->sem, t->mtx);
     }
-    putsUart0("------------------------------------------------------\n\n");
+    putsBlock(out, "-------------------------------------------------------------------------------\n\n");
+    closeBlock(out);
 }
 
-void ipcs() {
-    IPCS ipcs[MAX_SEMAPHORES+MAX_MUTEXES] = {0};
-    __asm(" SVC #10 ");
-
+void ipcs(SHELL_SCRATCH *scratch) {
+    SNAPSHOT *snap = &scratch->snap;
+    UART_BLOCK *out = &scratch->out;
+    uint32_t q[MAX_SEMAPHORE_QUEUE_SIZE > MAX_MUTEX_QUEUE_SIZE ? MAX_SEMAPHORE_QUEUE_SIZE : MAX_MUTEX_QUEUE_SIZE];
+    uint32_t owner;
     uint8_t i, j;
 
-    putsUart0("\nSemaph\t\tCount\t\tQ-Size\tQueue\n");
-    putsUart0("--------------------------------------------------\n");
-    for(i=0; i<MAX_SEMAPHORES; i++)
-        printSem(i, ipcs[i].sCount, ipcs[i].qSize, ipcs[i].q);
-    putsUart0("--------------------------------------------------\n\n");
+    if(!scratch || !_snapshot(snap))
+        return;
 
-    putsUart0("\nMutex\tState\tLock-By\t\tQ-Size\tQueue\n");
-    putsUart0("--------------------------------------------------\n");
-    for(j=0; j<MAX_MUTEXES; j++)
-        printMtx(j, ipcs[i+j].mLock, ipcs[i+j].mLockedBy, ipcs[i+j].qSize, ipcs[i+j].q);
-    putsUart0("--------------------------------------------------\n\n");
+    openBlock(out);
 
+    putsBlock(out, "\nSemaph\t\tCount\t\tQ-Size\tQueue\n");
+    putsBlock(out, "--------------------------------------------------\n");
+    for(i=0; i<snap->semCount; i++) {
+        for(j=0; j<snap->sem[i].qSize; j++)             // queued task indices to PIDs
+            q[j] = snap->task[snap->sem[i].q[j]].pid;
+        printSem(out, i, snap->sem[i].count, snap->sem[i].qSize, q);
+    }
+    putsBlock(out, "--------------------------------------------------\n\n");
+
+    putsBlock(out, "\nMutex\tState\tLock-By\t\tQ-Size\tQueue\n");
+    putsBlock(out, "--------------------------------------------------\n");
+    for(i=0; i<snap->mtxCount; i++) {
+        for(j=0; j<snap->mtx[i].qSize; j++)
+            q[j] = snap->task[snap->mtx[i].q[j]].pid;
+        owner = snap->mtx[i].lock ? snap->task[snap->mtx[i].lockedBy].pid : 0;  // lockedBy is stale once unlocked
+        printMtx(out, i, snap->mtx[i].lock, owner, snap->mtx[i].qSize, q);
+    }
+    putsBlock(out, "--------------------------------------------------\n\n");
+    closeBlock(out);
 }
 
 void kill(uint32_t pid) {
@@ -314,27 +533,305 @@ bool runProc(char *name) {
     return true;
 }
 
-void meminfo() {
-    MEM mem[HCB_MAX_SIZE] = {0};
-    __asm(" SVC #18 ");
-
-    uint8_t i = 0;
+void meminfo(SHELL_SCRATCH *scratch) {
+    SNAPSHOT *snap = &scratch->snap;
+    UART_BLOCK *out = &scratch->out;
+    uint8_t i;
     uint32_t total = 0;
     uint32_t free = 0;
 
-    putsUart0("\nPID\t\tBase Address\tAlloc-Size\n");
-    putsUart0("------------------------------------------\n");
-    while(mem[i].size) {
-        printMem(mem[i].pid, mem[i].baseAdd, mem[i].size);
-        total += mem[i].size;
-        i++;
+    if(!scratch || !_snapshot(snap))
+        return;
+
+    openBlock(out);
+
+    putsBlock(out, "\nPID\t\tBase Address\tAlloc-Size\n");
+    putsBlock(out, "------------------------------------------\n");
+    for(i=0; i<snap->allocCount; i++) {
+        printMem(out, snap->alloc[i].pid, snap->alloc[i].baseAdd, snap->alloc[i].size);
+        total += snap->alloc[i].size;
     }
-    putsUart0("------------------------------------------\n");
-    display("Memory Used:\t\t\t", total, 0, 0);
-    putsUart0("------------------------------------------\n");
-    display("Total Memory:\t\t\t", MEM_TOTAL, 0, 0);
+    putsBlock(out, "------------------------------------------\n");
+    displayBlock(out, "Memory Used:\t\t\t", total, 0, 0);
+    putsBlock(out, "------------------------------------------\n");
+    displayBlock(out, "Total Memory:\t\t\t", MEM_TOTAL, 0, 0);
     free = MEM_TOTAL - total;
-    display("Memory Free:\t\t\t", free, 0, 0);
-    putsUart0("------------------------------------------\n\n");
+    displayBlock(out, "Memory Free:\t\t\t", free, 0, 0);
+    putsBlock(out, "------------------------------------------\n\n");
+    closeBlock(out);
+}
+
+// Heap bytes allocated by the task with this pid
+uint16_t snapHeapOf(SNAPSHOT *snap, uint32_t pid) {
+    uint16_t total = 0;
+    uint8_t i;
+
+    for(i=0; i<snap->allocCount; i++)
+        if(snap->alloc[i].pid == pid)
+            total += snap->alloc[i].size;
+    return total;
+}
+
+void putCsvUint(UART_BLOCK *out, uint32_t n) {
+    char str[12];
+
+    fmtUint(str, n, 0, ' ');
+    putsBlock(out, ",");
+    putsBlock(out, str);
 }
 
+// Little endian field into a binary record, returns the next free byte
+uint8_t *putStatField(uint8_t *p, uint32_t n, uint8_t bytes) {
+    while(bytes--) {
+        *p++ = n;
+        n >>= 8;
+    }
+    return p;
+}
+
+// Zero-sum checksum, COBS and 0x00 delimiters, the same framing as the binary log
+void putStatFrame(UART_BLOCK *out, uint8_t *payload, uint8_t len) {
+    uint8_t frame[STAT_PAYLOAD_MAX + 3];
+    uint8_t sum = 0;
+    uint8_t i, n;
+
+    for(i=0; i<len; i++)
+        sum += payload[i];
+    payload[len++] = -sum;
+
+    frame[0] = 0;
+    n = 1 + cobsEncode(payload, len, &frame[1]);
+    frame[n++] = 0;
+    putBytesBlock(out, frame, n);
+}
+
+void statCsv(UART_BLOCK *out, SNAPSHOT *snap) {
+    char str[12];
+    uint16_t used = 0;
+    uint8_t i;
+
+    for(i=0; i<snap->allocCount; i++)
+        used += snap->alloc[i].size;
+
+    putsBlock(out, "S");
+    putCsvUint(out, snap->generation);
+    putCsvUint(out, snap->time);
+    putCsvUint(out, snap->taskCount);
+    putCsvUint(out, used);
+    putCsvUint(out, MEM_TOTAL);
+    for(i=0; i<snap->semCount; i++)
+        putCsvUint(out, snap->sem[i].count);
+    putsBlock(out, "\n");
+
+    for(i=0; i<snap->taskCount; i++) {
+        SNAP_TASK *t = &snap->task[i];
+
+        putsBlock(out, "T");
+        putCsvUint(out, snap->generation);
+        putCsvUint(out, i);
+        fmtHex(str, t->pid, 0);
+        putsBlock(out, ",0x");
+        putsBlock(out, str);
+        putsBlock(out, ",");
+        putsBlock(out, t->name);
+        putCsvUint(out, t->state);
+        putCsvUint(out, t->priority);
+        putCsvUint(out, t->cpuTicks);
+        putCsvUint(out, t->stackPeak);
+        putCsvUint(out, t->stackSize);
+        putCsvUint(out, snapHeapOf(snap, t->pid));
+        putsBlock(out, "\n");
+    }
+}
+
+void statBinary(UART_BLOCK *out, SNAPSHOT *snap) {
+    uint8_t payload[STAT_PAYLOAD_MAX];
+    uint8_t *p;
+    uint16_t used = 0;
+    uint8_t i, j;
+
+    for(i=0; i<snap->allocCount; i++)
+        used += snap->alloc[i].size;
+
+    p = payload;
+    *p++ = STAT_SUMMARY;
+    *p++ = STAT_VERSION;
+    *p++ = snap->taskCount;
+    *p++ = snap->semCount;
+    p = putStatField(p, snap->generation, 4);
+    p = putStatField(p, snap->time, 4);
+    p = putStatField(p, used, 2);
+    p = putStatField(p, MEM_TOTAL, 2);
+    for(i=0; i<snap->semCount; i++)
+        *p++ = snap->sem[i].count;
+    putStatFrame(out, payload, p - payload);
+
+    for(i=0; i<snap->taskCount; i++) {
+        SNAP_TASK *t = &snap->task[i];
+
+        p = payload;
+        *p++ = STAT_TASK;
+        *p++ = STAT_VERSION;
+        *p++ = i;
+        *p++ = t->state;
+        p = putStatField(p, snap->generation, 4);
+        p = putStatField(p, t->pid, 4);
+        p = putStatField(p, t->cpuTicks, 4);
+        p = putStatField(p, t->stackPeak, 2);
+        p = putStatField(p, t->stackSize, 2);
+        p = putStatField(p, snapHeapOf(snap, t->pid), 2);
+        *p++ = t->priority;
+        for(j=0; j<STAT_NAME_MAX && t->name[j]; j++)
+            *p++ = t->name[j];
+        putStatFrame(out, payload, p - payload);
+    }
+}
+
+// One snapshot as CSV lines or binary frames (statrec.h). A period repeats it every
+// period ms until a key is pressed, the key is then eaten
+void telemetry(SHELL_SCRATCH *scratch, bool binary, uint32_t period) {
+    SNAPSHOT *snap = &scratch->snap;
+    UART_BLOCK *out = &scratch->out;
+
+    do {
+        if(!scratch || !_snapshot(snap))
+            return;
+
+        openBlock(out);
+        if(binary)
+            statBinary(out, snap);
+        else
+            statCsv(out, snap);
+        closeBlock(out);
+
+        if(period)
+            sleep(period);
+    } while(period && !kbhitUart0());
+
+    if(period)
+        getcUart0();
+}
+
+// Task names (S and T records) then the newest trace events as R records, statrec.h
+void trace(SHELL_SCRATCH *scratch) {
+    TRACE_EVENT *events = scratch->data.events;
+    SNAPSHOT *snap = &scratch->snap;
+    UART_BLOCK *out = &scratch->out;
+    uint8_t payload[STAT_PAYLOAD_MAX];
+    uint8_t *p;
+    uint16_t count, i, j;
+
+    if(!scratch)
+        return;
+    count = _traceRead(events, TRACE_EVENTS);          // first, so the dump does not trace itself
+    if(!count || !_snapshot(snap)) {
+        putsUart0("No trace, TRACE_ENABLE is 0\n\n");
+        return;
+    }
+
+    openBlock(out);
+    statBinary(out, snap);
+    for(i=0; i<count; i+=j) {
+        p = payload;
+        *p++ = STAT_TRACE;
+        *p++ = STAT_VERSION;
+        p++;                                            // count, filled in below
+        for(j=0; j<STAT_TRACE_PER_FRAME && i+j<count; j++) {
+            p = putStatField(p, events[i+j].time, 4);
+            p = putStatField(p, events[i+j].info, 4);
+        }
+        payload[2] = j;
+        putStatFrame(out, payload, p - payload);
+    }
+    putsBlock(out, "\n");
+    closeBlock(out);
+}
+
+// One row per histogram: count, max since reset, worst since power up, then each
+// non-empty bucket as <upper bound in cycles>:<count>
+void lat(SHELL_SCRATCH *scratch, bool reset) {
+    static const char *names[LAT_COUNT] = {             // padded to the Latency column
+        "systick  ", "wtimer1  ", "svc      ", "pendsv   ", "sleep    ", "isr post ", "task post"
+    };
+    LAT_HIST *hist = scratch->data.hist;
+    UART_BLOCK *out = &scratch->out;
+    char str[12];
+    uint32_t count;
+    uint8_t i, j;
+
+    if(!scratch)
+        return;
+    if(!_latRead(hist, reset)) {
+        putsUart0("No latency stats, there was no heap left for them\n\n");
+        return;
+    }
+
+    openBlock(out);
+    putsBlock(out, "Latency     Count      Max    Worst Buckets (< cycles:count)\n");
+    putsBlock(out, "--------------------------------------------------------------\n");
+    for(i=0; i<LAT_COUNT; i++) {
+        count = 0;
+        for(j=0; j<LAT_BUCKETS; j++)
+            count += hist[i].bucket[j];
+
+        putsBlock(out, names[i]);
+        fmtUint(str, count, 8, ' ');
+        putsBlock(out, str);
+        fmtUint(str, hist[i].max, 9, ' ');
+        putsBlock(out, str);
+        fmtUint(str, hist[i].worst, 9, ' ');
+        putsBlock(out, str);
+
+        for(j=0; j<LAT_BUCKETS; j++) {
+            if(!hist[i].bucket[j])
+                continue;
+            putsBlock(out, " ");
+            if(j == LAT_BUCKETS-1)
+                putsBlock(out, "more");
+            else {
+                fmtUint(str, (uint32_t)1 << (j + LAT_MIN_SHIFT + 1), 0, ' ');
+                putsBlock(out, str);
+            }
+            putsBlock(out, ":");
+            fmtUint(str, hist[i].bucket[j], 0, ' ');
+            putsBlock(out, str);
+        }
+        putsBlock(out, "\n");
+    }
+    if(reset)
+        putsBlock(out, "Counts and max cleared, worst kept\n");
+    putsBlock(out, "\n");
+    closeBlock(out);
+}
+
+// P line, then a C line per PC sampled (prof.h). The counts keep growing while the
+// profiler is on, so a dump taken then is a snapshot
+void profDump(SHELL_SCRATCH *scratch) {
+    PROF_DATA *data = &scratch->data.prof;
+    UART_BLOCK *out = &scratch->out;
+    char str[12];
+    uint8_t i;
+
+    if(!scratch || !_profRead(data))
+        return;
+
+    openBlock(out);
+    putsBlock(out, "P");
+    putCsvUint(out, data->samples);
+    putCsvUint(out, data->missed);
+    putCsvUint(out, PROF_HZ);
+    putsBlock(out, "\n");
+    for(i=0; i<PROF_SLOTS; i++) {
+        if(!data->slot[i].pc)
+            continue;
+        fmtHex(str, data->slot[i].pc, 0);
+        putsBlock(out, "C,0x");
+        putsBlock(out, str);
+        putCsvUint(out, data->slot[i].count);
+        putsBlock(out, "\n");
+    }
+    if(data->on)
+        putsBlock(out, "Profiler still on\n");
+    putsBlock(out, "\n");
+    closeBlock(out);
+}
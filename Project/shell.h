@@ -12,32 +12,93 @@
 #define SHELL_H_
 
 #include <stdbool.h>
+#include "uart0.h"
+#include "kernel.h"
+#include "mm.h"
 
-typedef struct _PS {
+// One copy of kernel state taken by a single SVC, so ps, ipcs and meminfo agree.
+// Fields are ordered largest first so the records pack without padding.
+#define SNAPSHOT_VERSION 3
+
+typedef struct _SNAP_TASK {
+    uint32_t pid;
+    uint32_t cpuTicks;      // DWT cycles run over the CPU% window
     char name[16];
-    uint32_t PID;
-    uint16_t cpu;
+    uint32_t voluntary;     // switches by yield, sleep, wait or lock
+    uint32_t involuntary;   // preemptions
+    uint32_t maxResponse;   // longest READY to RUNNING, cycles
+    uint32_t readyMs;       // time ready but not running
+    uint32_t delayedMs;     // time asleep
+    uint32_t mutexMs;       // time blocked on a mutex
+    uint32_t semaphoreMs;   // time blocked on a semaphore
+    uint32_t execMin;       // CPU cycles from release to blocking
+    uint32_t execMean;
+    uint32_t execMax;
+    uint32_t overruns;      // releases over budget
+    uint16_t cpu;           // hundredths of a percent
+    uint16_t stackDepth;    // current SP depth in bytes
+    uint16_t stackPeak;     // high-water mark in bytes
+    uint16_t stackSize;     // stack reserved at creation
+    uint16_t releases;      // releases execMean is over, halved now and then
+    uint16_t budget;        // us per release, 0 = none
     uint8_t state;
+    uint8_t priority;
     uint8_t sem;
     uint8_t mtx;
-} PS;
-
-typedef struct _IPCS {
-    bool mLock;
-    uint8_t sCount;
-    uint8_t qSize;
-    uint32_t q[2];
-    uint32_t mLockedBy;
-} IPCS;
+} SNAP_TASK;
 
-typedef struct _MEM {
+typedef struct _SNAP_ALLOC {
     uint32_t pid;
     uint32_t baseAdd;
     uint16_t size;
-} MEM;
+    uint8_t handle;         // NO_HANDLE unless relocatable
+    uint8_t refCount;       // tasks attached to a shared region
+} SNAP_ALLOC;
+
+typedef struct _SNAP_SEM {
+    uint8_t count;
+    uint8_t qSize;
+    uint8_t q[MAX_SEMAPHORE_QUEUE_SIZE];    // task indices into SNAPSHOT.task
+} SNAP_SEM;
+
+typedef struct _SNAP_MTX {
+    uint8_t lock;
+    uint8_t lockedBy;                       // task index
+    uint8_t qSize;
+    uint8_t q[MAX_MUTEX_QUEUE_SIZE];        // task indices into SNAPSHOT.task
+} SNAP_MTX;
+
+typedef struct _SNAPSHOT {
+    uint16_t version;       // SNAPSHOT_VERSION of the kernel that filled it
+    uint16_t size;          // sizeof(SNAPSHOT) of the kernel that filled it
+    uint32_t generation;    // bumped on every snapshot taken
+    uint32_t time;          // TIMER2 cycle count when taken
+    uint8_t taskCount;
+    uint8_t allocCount;
+    uint8_t semCount;
+    uint8_t mtxCount;
+    SNAP_TASK task[MAX_TASKS];
+    SNAP_ALLOC alloc[HCB_MAX_SIZE];
+    SNAP_SEM sem[MAX_SEMAPHORES];
+    SNAP_MTX mtx[MAX_MUTEXES];
+} SNAPSHOT;
+
+// ps views
+#define PS_STATUS   0
+#define PS_SCHED    1       // -v
+#define PS_EXEC     2       // -w
 
 #define MEM_TOTAL 0x7000
 
+struct _SHELL_SCRATCH;
+
+typedef struct _SHELL_CMD {
+    const char *name;
+    uint8_t minArgs;                        // fields needed after the command name
+    bool (*handler)(COMMAND_DATA *data, struct _SHELL_SCRATCH *scratch);    // false prints Invalid Command
+    const char *help;
+} SHELL_CMD;
+
 #define SUCCESS     1
 #define FAILURE     0
 
@@ -66,8 +127,8 @@ typedef struct _MEM {
 void shell();
 
 void reboot();
-void ps();
-void ipcs();
+void ps(struct _SHELL_SCRATCH *scratch, uint8_t view);
+void ipcs(struct _SHELL_SCRATCH *scratch);
 void kill(uint32_t pid);
 void pkill(char *name);
 void pi(bool on);
@@ -75,6 +136,12 @@ void preempt(bool on);
 void sched(bool prio_on);
 void pidof(const char name[]);
 bool runProc(char *name);
-void meminfo();
+void meminfo(struct _SHELL_SCRATCH *scratch);
+void telemetry(struct _SHELL_SCRATCH *scratch, bool binary, uint32_t period);
+void trace(struct _SHELL_SCRATCH *scratch);
+void lat(struct _SHELL_SCRATCH *scratch, bool reset);
+void profDump(struct _SHELL_SCRATCH *scratch);
+void help(struct _SHELL_SCRATCH *scratch);
+const SHELL_CMD *findCommand(const char name[]);
 
 #endif
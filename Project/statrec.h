@@ -0,0 +1,38 @@
+// Telemetry record layout
+// J Losh
+
+// Records sent by the shell's stat command, shared with tools/statparse.c.
+//
+// CSV, one line per record:
+//   S,<generation>,<time>,<tasks>,<heap used>,<heap total>,<sem 0 count>,...
+//   T,<generation>,<index>,<pid>,<name>,<state>,<priority>,<cpu ticks>,<stack peak>,<stack size>,<heap>
+// pid is hex with a 0x prefix, everything else decimal. time is the TIMER2 cycle count,
+// cpu ticks are the DWT cycles the task ran over the CPU% window. tasks counts tcb records
+// up to the highest in use, state 0 is a free one (a detached task ended).
+//
+// Binary, framed like log records: 0x00, COBS(payload, zero-sum checksum byte), 0x00.
+// Payloads are little endian. The first byte is STAT_SUMMARY or STAT_TASK, which can not
+// be the task byte that starts a log record (a task index or 0xFF), so both share the UART.
+//   S: type, version, tasks, sems, generation(4), time(4), heap used(2), heap total(2),
+//      sem counts(sems)
+//   T: type, version, index, state, generation(4), pid(4), cpu ticks(4), stack peak(2),
+//      stack size(2), heap(2), priority, name (up to 15 chars, no terminator)
+//   R: type, version, count, then count trace events of DWT time(4), info(4), see trace.h.
+//      The trace command sends S and T records first so tools can name the tasks
+
+#ifndef STATREC_H_
+#define STATREC_H_
+
+#define STAT_VERSION        1
+#define STAT_SUMMARY        'S'
+#define STAT_TASK           'T'
+#define STAT_TRACE          'R'
+
+#define STAT_SUMMARY_FIXED  16              // summary bytes before the semaphore counts
+#define STAT_TASK_FIXED     23              // task bytes before the name
+#define STAT_NAME_MAX       15
+#define STAT_TRACE_FIXED    3               // trace bytes before the events
+#define STAT_TRACE_PER_FRAME 4
+#define STAT_PAYLOAD_MAX    (STAT_TASK_FIXED + STAT_NAME_MAX + 1)
+
+#endif
@@ -0,0 +1,245 @@
+// Kernel statistics
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hal.h"
+#include "stats.h"
+#include "kernel.h"
+#include "mm.h"
+#include "asp.h"
+#include "shell.h"
+
+KERNEL_STATS *kstats = 0;                   // 0 until initStats, recording is skipped before boot
+extern uint8_t taskCurrent;
+
+// PendSV is naked, the switch state is kept here between statsSwitchOut and statsSwitchIn
+static uint8_t switchFrom = 0;
+static uint8_t switchFromState = 0;
+static bool yielded = false;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Called once before the RTOS starts, after every task stack has been allocated
+bool initStats(void)
+{
+    uint32_t *p;
+    uint16_t i;
+
+    p = mallocKernel(sizeof(KERNEL_STATS));
+    if(!p)
+        return false;
+
+    for(i=0; i<sizeof(KERNEL_STATS)/4; i++)
+        p[i] = 0;
+    kstats = (KERNEL_STATS *)p;
+    return true;
+}
+
+// Count one measurement, CLZ picks the bucket without a loop
+void latRecord(uint8_t hist, uint32_t cycles)
+{
+    LAT_HIST *h;
+    int8_t b;
+
+    if(!kstats)
+        return;
+
+    h = &kstats->lat[hist];
+    b = 31 - countLeadingZeros(cycles | 1) - LAT_MIN_SHIFT;
+    if(b < 0)
+        b = 0;
+    else if(b >= LAT_BUCKETS)
+        b = LAT_BUCKETS - 1;
+
+    if(h->bucket[b] != 0xFFFF)
+        h->bucket[b]++;
+    if(cycles > h->max)
+        h->max = cycles;
+    if(cycles > h->worst)
+        h->worst = cycles;
+}
+
+// The task was just made ready, kind says which histogram its release-to-run goes in
+void statsReady(uint8_t task, uint8_t kind)
+{
+    if(!kstats)
+        return;
+
+    kstats->task[task].readyAt = DWT_CYCCNT_R;
+    kstats->task[task].readyKind = kind;
+    kstats->task[task].ready = true;
+}
+
+// The running task called yield, its next switch out is voluntary though it stays ready
+void statsYield(void)
+{
+    yielded = true;
+}
+
+// Called by PendSV before the scheduler, with the state of the task being switched out.
+// Any state but ready ends its release, exec is the CPU cycles it took (the tcb keeps the
+// release start, budgets do not depend on the stats)
+void statsSwitchOut(uint8_t state, uint32_t exec)
+{
+    TASK_STATS *t;
+
+    switchFrom = taskCurrent;
+    switchFromState = state;
+
+    if(kstats && state != STATE_READY) {
+        t = &kstats->task[taskCurrent];
+        if(t->releases == 0xFFFF || t->execSum > 0xFFFFFFFF - exec) {
+            t->releases >>= 1;
+            t->execSum >>= 1;
+        }
+        if(!t->releases && !t->execMax)
+            t->execMin = exec;
+        if(exec < t->execMin)
+            t->execMin = exec;
+        if(exec > t->execMax)
+            t->execMax = exec;
+        t->execSum += exec;
+        t->releases++;
+    }
+
+    if(kstats && state == STATE_READY) {            // Waits for the CPU from now on
+        kstats->task[taskCurrent].readyAt = DWT_CYCCNT_R;
+        kstats->task[taskCurrent].readyKind = 0;
+        kstats->task[taskCurrent].ready = true;
+    }
+}
+
+void statsOverrun(uint8_t task)
+{
+    if(kstats && kstats->task[task].overruns != 0xFFFF)
+        kstats->task[task].overruns++;
+}
+
+// A spawned task starts with no history, its tcb record may have held another task
+void statsClear(uint8_t task)
+{
+    uint32_t *p;
+    uint8_t i;
+
+    if(!kstats)
+        return;
+    p = (uint32_t *)&kstats->task[task];
+    for(i=0; i<sizeof(TASK_STATS)/4; i++)
+        p[i] = 0;
+}
+
+// Called by PendSV once the scheduler has picked taskCurrent
+void statsSwitchIn(void)
+{
+    TASK_STATS *t;
+    uint32_t response;
+
+    if(kstats && taskCurrent != switchFrom) {
+        if(switchFromState != STATE_READY || yielded)
+            kstats->task[switchFrom].voluntary++;
+        else
+            kstats->task[switchFrom].involuntary++;
+
+        t = &kstats->task[taskCurrent];
+        if(t->ready) {
+            response = DWT_CYCCNT_R - t->readyAt;
+            if(response > t->maxResponse)
+                t->maxResponse = response;
+            if(t->readyKind)
+                latRecord(t->readyKind, response);
+        }
+    }
+
+    if(kstats) {                                    // Running now, also when picked again
+        kstats->task[taskCurrent].ready = false;
+        kstats->task[taskCurrent].readyKind = 0;
+    }
+    yielded = false;
+}
+
+// Called by SysTick for every task, charges the ms to the state the task is in
+void statsTick(uint8_t task, uint8_t state)
+{
+    TASK_STATS *t;
+
+    if(!kstats)
+        return;
+
+    t = &kstats->task[task];
+    switch(state) {
+        case STATE_READY:
+            if(task != taskCurrent)
+                t->readyMs++;
+            break;
+        case STATE_DELAYED:
+            t->delayedMs++;
+            break;
+        case STATE_BLOCKED_MUTEX:
+            t->mutexMs++;
+            break;
+        case STATE_BLOCKED_SEMAPHORE:
+            t->semaphoreMs++;
+            break;
+    }
+}
+
+// Scheduling stats of a task into its ps record, zeros if stats are disabled
+void statsTask(uint8_t task, SNAP_TASK *t)
+{
+    TASK_STATS *s;
+
+    if(!kstats) {
+        t->voluntary = t->involuntary = t->maxResponse = 0;
+        t->readyMs = t->delayedMs = t->mutexMs = t->semaphoreMs = 0;
+        t->execMin = t->execMean = t->execMax = t->releases = t->overruns = 0;
+        return;
+    }
+
+    s = &kstats->task[task];
+    t->voluntary = s->voluntary;
+    t->involuntary = s->involuntary;
+    t->maxResponse = s->maxResponse;
+    t->readyMs = s->readyMs;
+    t->delayedMs = s->delayedMs;
+    t->mutexMs = s->mutexMs;
+    t->semaphoreMs = s->semaphoreMs;
+    t->execMin = s->execMin;
+    t->execMean = s->releases ? s->execSum / s->releases : 0;
+    t->execMax = s->execMax;
+    t->releases = s->releases;
+    t->overruns = s->overruns;
+}
+
+// SVC side of _latRead, reset clears counts and max but keeps the worst case.
+// False if stats are disabled
+bool latCopy(LAT_HIST *buf, bool reset)
+{
+    uint8_t i, j;
+
+    if(!kstats)
+        return false;
+
+    for(i=0; i<LAT_COUNT; i++) {
+        buf[i] = kstats->lat[i];
+        if(reset) {
+            kstats->lat[i].max = 0;
+            for(j=0; j<LAT_BUCKETS; j++)
+                kstats->lat[i].bucket[j] = 0;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,85 @@
+// Kernel statistics
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel.h"
+
+// Latency histograms, log2 buckets in cycles: bucket 0 counts anything under
+// 2^(LAT_MIN_SHIFT+1), bucket b counts [2^(b+LAT_MIN_SHIFT), 2^(b+LAT_MIN_SHIFT+1)),
+// the last bucket also counts everything longer (2^22 cycles is 105 ms)
+#define LAT_BUCKETS     20
+#define LAT_MIN_SHIFT   3
+
+#define LAT_SYSTICK     0       // SysTick raised to ISR entry
+#define LAT_WTIMER1     1       // WTIMER1 timeout to ISR entry
+#define LAT_SVC         2       // SVC handler entry to exit
+#define LAT_PENDSV      3       // PendSV duration, save to restore
+#define LAT_WAKE_SLEEP  4       // sleep() expired (SysTick) to the task running
+#define LAT_WAKE_ISR    5       // post from an ISR (UART) to the task running
+#define LAT_WAKE_TASK   6       // post or unlock by another task to the task running
+#define LAT_COUNT       7
+
+typedef struct _LAT_HIST {
+    uint32_t max;                   // since the last reset
+    uint32_t worst;                 // since power up, lat reset keeps it
+    uint16_t bucket[LAT_BUCKETS];   // saturate at 0xFFFF
+} LAT_HIST;
+
+typedef struct _TASK_STATS {
+    uint32_t readyAt;               // DWT time the task was made ready or switched out ready
+    uint32_t maxResponse;           // longest READY to RUNNING, cycles
+    uint32_t voluntary;             // switched out by yield, sleep, wait or lock
+    uint32_t involuntary;           // preempted while still ready
+    uint32_t readyMs;               // ms ready but not running
+    uint32_t delayedMs;             // ms asleep
+    uint32_t mutexMs;               // ms blocked on a mutex
+    uint32_t semaphoreMs;           // ms blocked on a semaphore
+    uint32_t execMin;               // CPU cycles from release to blocking, over releases
+    uint32_t execMax;
+    uint32_t execSum;               // halved with releases before it overflows, keeps the mean
+    uint16_t releases;
+    uint16_t overruns;              // releases over the task's budget
+    uint8_t readyKind;              // LAT_WAKE_ histogram to charge when it runs, 0 if none
+    bool ready;                     // readyAt is valid
+} TASK_STATS;
+
+// Lives in a kernel-owned heap block, kernel RAM below the heap is full. Keep it within
+// 1024 bytes so it takes a single sub-region. rtos.c does not start the RTOS without it
+typedef struct _KERNEL_STATS {
+    LAT_HIST lat[LAT_COUNT];
+    TASK_STATS task[MAX_TASKS];
+} KERNEL_STATS;
+
+extern KERNEL_STATS *kstats;
+
+// ps record (shell.h)
+struct _SNAP_TASK;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+bool initStats(void);
+void latRecord(uint8_t hist, uint32_t cycles);
+void statsReady(uint8_t task, uint8_t kind);
+void statsYield(void);
+void statsSwitchOut(uint8_t state, uint32_t exec);
+void statsOverrun(uint8_t task);
+void statsClear(uint8_t task);
+void statsSwitchIn(void);
+void statsTick(uint8_t task, uint8_t state);
+void statsTask(uint8_t task, struct _SNAP_TASK *t);
+bool latCopy(LAT_HIST *buf, bool reset);
+
+#endif
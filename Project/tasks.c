@@ -20,6 +20,7 @@
 #include "kernel.h"
 #include "tasks.h"
 #include "mm.h"
+#include "stats.h"
 
 #define BLUE_LED    PORTF,2 // on-board blue LED
 #define RED_LED     PORTA,2 // off-board red LED
@@ -88,13 +89,6 @@ void initHw(void)
     // Enalbe MPU
     NVIC_MPU_CTRL_R |= NVIC_MPU_CTRL_PRIVDEFEN | NVIC_MPU_CTRL_ENABLE;
 
-    // Configure a free running timer to time tasks
-    SYSCTL_RCGCWTIMER_R |= SYSCTL_RCGCWTIMER_R0;
-    _delay_cycles(3);
-    WTIMER0_CTL_R &= ~TIMER_CTL_TAEN;
-    WTIMER0_TAMR_R |= TIMER_TAMR_TAMR_1_SHOT | TIMER_TAMR_TACDIR;
-    WTIMER0_TAV_R = 0;
-
     initLEDpwm();
 }
 
@@ -123,6 +117,8 @@ uint16_t dutyCycle = 0;
 int8_t step = 1;
 
 void wTimer1Isr() {
+    latRecord(LAT_WTIMER1, WTIMER1_TAILR_R - WTIMER1_TAV_R);  // Down counter reloaded at the timeout
+
     if(dutyCycle > 100)
         dutyCycle = 100;
 
@@ -160,6 +156,8 @@ void idle(void)
         setPinValue(ORANGE_LED, 1);
         waitMicrosecond(1000);
         setPinValue(ORANGE_LED, 0);
+        _compactHeap();                 // Nothing else to run, defragment heap if needed
+        _logFlush();                    // and send deferred log records
         yield();
     }
 }
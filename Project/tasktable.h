@@ -0,0 +1,24 @@
+// Application task table
+// J Losh
+
+// X-macro list of the tasks rtos.c creates (Idle aside), in creation order. tools/rta.c
+// includes the same file to run response time analysis on it and suggest priorities.
+//   TASK(fn, name, priority, stack bytes, period ms, wcet us, deadline ms, mutex, cs us)
+// priority 0 is highest. period is the release period, or the shortest time between two
+// releases of an event driven task; 0 marks a background task that is always ready and
+// gets no guarantee. wcet is the CPU time of one release (wake to the next sleep, wait or
+// blocking lock), also the budget the kernel holds the task to (0 for none): a release
+// that runs longer is logged and demoted below the other tasks until it blocks. A
+// background task's wcet is only that budget. deadline is relative to the release.
+// mutex is the one the task locks (none if it locks none) and cs the longest time it
+// holds it, which is what it can block a higher priority task for
+
+TASK(lengthyFn,     "LengthyFn",    12, 1024,   0,      0,      0,      resource,   5000000)
+TASK(flash4Hz,      "Flash4Hz",     8,  512,    125,    50,     125,    none,       0)
+TASK(oneshot,       "OneShot",      4,  1536,   1000,   50,     100,    none,       0)
+TASK(readKeys,      "ReadKeys",     12, 1024,   0,      0,      0,      none,       0)
+TASK(debounce,      "Debounce",     12, 1024,   10,     50,     10,     none,       0)
+TASK(important,     "Important",    0,  1024,   1000,   50,     1000,   resource,   1000000)
+TASK(uncooperative, "Uncoop",       12, 1024,   0,      1000,   0,      none,       0)
+TASK(errant,        "Errant",       12, 512,    0,      0,      0,      none,       0)
+TASK(shell,         "Shell",        12, 4096,   100,    5000,   100,    none,       0)
@@ -11,9 +11,15 @@
 MEMORY
 {
     FLASH (RX) : origin = 0x00000000, length = 0x00040000
-    SRAM (RWX) : origin = 0x20000000, length = 0x00008000
+    SRAM (RWX) : origin = 0x20000000, length = 0x00001000
+    HEAP (RWX) : origin = 0x20001000, length = 0x00007000
 }
 
+/* Kernel statics and the main stack live in SRAM, the 4 KiB below the RTOS */
+/* heap (mm.c). HEAP is managed by mm.c at run time and holds no sections,   */
+/* so a kernel that outgrows SRAM fails to link instead of overlapping the   */
+/* heap. Large kernel buffers are taken with mallocKernel at boot instead.   */
+
 /* The following command line options are set as part of the CCS project.    */
 /* If you are building using the command line, or for some reason want to    */
 /* define them here, you can uncomment and modify these lines as needed.     */
@@ -40,7 +46,7 @@ SECTIONS
     .bss    :   > SRAM
     .sysmem :   > SRAM
     .stack  :   > SRAM
-    .heap   :   > 0x20001000
+    .heap   :   > HEAP
 }
 
 __STACK_TOP = __stack + 512;
@@ -0,0 +1,59 @@
+// Kernel event trace
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mm.h"
+#include "trace.h"
+
+#if TRACE_ENABLE
+TRACE_EVENT *traceRing = 0;                 // kernel heap block, see initTrace
+uint32_t traceHead = 0;                     // events recorded since reset
+#endif
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Called by initRtos before SysTick starts and so before the first TRACE(). The ring fills
+// one 512 byte sub-region, kernel RAM below the heap has no room for it
+bool initTrace(void)
+{
+#if TRACE_ENABLE
+    traceRing = mallocKernel(sizeof(TRACE_EVENT) * TRACE_EVENTS);
+    traceHead = 0;
+    return traceRing != 0;
+#else
+    return true;
+#endif
+}
+
+// SVC side of traceRead: the newest events (at most max), oldest first. Runs with the
+// recording handlers held off, so the copy is a consistent slice of the ring
+uint16_t traceCopy(TRACE_EVENT *buf, uint16_t max)
+{
+#if TRACE_ENABLE
+    uint32_t i, n;
+
+    n = (traceHead < TRACE_EVENTS) ? traceHead : TRACE_EVENTS;
+    if(n > max)
+        n = max;
+
+    for(i=traceHead-n; i!=traceHead; i++)
+        *buf++ = traceRing[i & (TRACE_EVENTS-1)];
+    return n;
+#else
+    return 0;
+#endif
+}
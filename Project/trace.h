@@ -0,0 +1,65 @@
+// Kernel event trace
+// J Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel.h"
+#include "hal.h"
+
+// 0 compiles every TRACE() out and frees the ring
+#define TRACE_ENABLE    1
+#define TRACE_EVENTS    64                  // power of 2, 8 bytes each in a kernel heap block
+
+#define TRACE_BLOCKED   0x100               // wait/lock arg flag, the caller blocked
+
+// Event ids, see tracefmt.h
+#define TRACE_EVT(id, name) id,
+enum {
+#include "tracefmt.h"
+    TRACE_EVT_COUNT
+};
+#undef TRACE_EVT
+
+// Fixed size record: DWT cycle count, then type | task << 8 | arg << 16
+typedef struct _TRACE_EVENT {
+    uint32_t time;
+    uint32_t info;
+} TRACE_EVENT;
+
+#define TRACE_TYPE(i)   ((i) & 0xFF)
+#define TRACE_TASK(i)   (((i) >> 8) & 0xFF)
+#define TRACE_ARG(i)    ((i) >> 16)
+
+extern uint8_t taskCurrent;
+
+#if TRACE_ENABLE
+extern TRACE_EVENT *traceRing;
+extern uint32_t traceHead;
+
+// Only called from handlers that can not preempt one another (all at priority 0), so the
+// ring needs no lock. No locals, it is also used in the naked pendSvIsr
+#define TRACE(type, arg) \
+    (traceRing[traceHead & (TRACE_EVENTS-1)].time = DWT_CYCCNT_R, \
+     traceRing[traceHead++ & (TRACE_EVENTS-1)].info = (type) | (uint32_t)taskCurrent << 8 | (uint32_t)(arg) << 16)
+#else
+#define TRACE(type, arg)
+#endif
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+bool initTrace(void);
+uint16_t traceCopy(TRACE_EVENT *buf, uint16_t max);
+
+#endif
@@ -0,0 +1,24 @@
+// Trace event table
+// J Losh
+
+// X-macro list of kernel trace events, the firmware stores the position in this list and
+// tools/trace2json.c includes the same file to name them. Append only, old dumps still decode.
+// Each event also records the running task and a 16-bit argument:
+//   switch     arg = priority the task was picked at (task = the task switched in)
+//   svc, svc exit   arg = SVC number
+//   isr        arg = exception number (IPSR), 15 is SysTick, 21 is UART0
+//   wait, lock arg = semaphore / mutex, | TRACE_BLOCKED if the task had to block
+//   post, unlock   arg = semaphore / mutex
+//   wake       arg = task made ready
+//   overrun    arg = us the running task has used since its release, over its budget
+
+TRACE_EVT(TR_SWITCH,    "switch")
+TRACE_EVT(TR_SVC,       "svc")
+TRACE_EVT(TR_SVC_EXIT,  "svc exit")
+TRACE_EVT(TR_ISR,       "isr")
+TRACE_EVT(TR_WAIT,      "wait")
+TRACE_EVT(TR_POST,      "post")
+TRACE_EVT(TR_LOCK,      "lock")
+TRACE_EVT(TR_UNLOCK,    "unlock")
+TRACE_EVT(TR_WAKE,      "wake")
+TRACE_EVT(TR_OVERRUN,   "overrun")
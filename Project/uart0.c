@@ -24,15 +24,54 @@
 #include "uart0.h"
 #include "gpio.h"
 #include "kernel.h"
+#include "mm.h"
+#include "asp.h"
+#include "fmt.h"
+#include "trace.h"
 
 // Pins
 #define UART_TX PORTA,1
 #define UART_RX PORTA,0
 
+// Ring buffer sizes, must be powers of 2
+#define TX_BUFFER_SIZE 128                  // kernel RAM below the heap is tight, bulk output goes by uDMA
+#define RX_BUFFER_SIZE 128                  // a pasted batch keeps arriving while a command runs
+
+// uDMA
+#define DMA_CH_UART0TX   9                  // channel 9, encoding 0 (CHMAP1 reset value)
+#define DMA_MAX_TRANSFER 1024               // XFERSIZE is 10 bits
+#define DMA_IDLE         0
+#define DMA_PENDING      1                  // queued behind ring bytes written before it
+#define DMA_ACTIVE       2
+
+// Auto-baud
+#define AUTOBAUD_EDGES   10                 // a character has at most 10 edges (start..stop)
+
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 
+// Ring buffers, only touched by uart0Isr and the UART SVCs (kernel memory)
+char txBuffer[TX_BUFFER_SIZE];
+char rxBuffer[RX_BUFFER_SIZE];
+uint16_t txHead = 0, txTail = 0;            // free running, index with & (SIZE-1)
+uint16_t rxHead = 0, rxTail = 0;
+bool txWaiting = false;                     // a writer is blocked on uartTxFree
+bool rxWaiting = false;                     // a reader is blocked on uartRxReady
+
+// uDMA control table, base must be 1024 aligned (CTLBASE bits 9:0 are reserved). Only the
+// primary entries up to channel 9 are ever read, so a 512 byte sub-region on a 1k boundary
+// holds it. Kernel heap block, aligned statics below the heap would pad out to 1k
+uint32_t *dmaTable = 0;
+
+// uDMA block transmit, one block in flight. Ring bytes before dmaMark go out first,
+// ring bytes written after the block was queued wait until it completes
+const uint8_t *dmaSrc;
+uint16_t dmaLength;
+uint16_t dmaMark;
+uint8_t dmaState = DMA_IDLE;
+bool dmaWaiting = false;                    // a writer is blocked on uartDmaDone
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -54,48 +93,469 @@ void initUart0(void)
     // Configure UART0 with default baud rate
     UART0_CTL_R = 0;                                    // turn-off UART0 to allow safe programming
     UART0_CC_R = UART_CC_CS_SYSCLK;                     // use system clock (usually 40 MHz)
+
+    // Interrupt when RX FIFO is half full or idle (timeout), and when TX FIFO is nearly empty
+    UART0_IFLS_R = UART_IFLS_RX4_8 | UART_IFLS_TX1_8;
+    UART0_IM_R = UART_IM_RXIM | UART_IM_RTIM | UART_IM_TXIM;
+    NVIC_EN0_R = 1 << (INT_UART0-16);
+}
+
+// Enable the uDMA controller and route channel 9 to UART0 TX. False if the heap has no
+// 1k aligned sub-region left for the control table
+bool initUart0Dma(void)
+{
+    uint8_t i;
+
+    dmaTable = alignedMallocKernel((DMA_CH_UART0TX+1)*16, 1024);
+    if(!dmaTable)
+        return false;
+    for(i=0; i<(DMA_CH_UART0TX+1)*4; i++)
+        dmaTable[i] = 0;
+
+    SYSCTL_RCGCDMA_R |= SYSCTL_RCGCDMA_R0;
+    _delay_cycles(3);
+    UDMA_CFG_R = UDMA_CFG_MASTEN;
+    UDMA_CTLBASE_R = (uint32_t)dmaTable;
+
+    UDMA_CHMAP1_R &= ~UDMA_CHMAP1_CH9SEL_M;             // UART0 TX
+    UDMA_PRIOCLR_R = 1 << DMA_CH_UART0TX;
+    UDMA_ALTCLR_R = 1 << DMA_CH_UART0TX;                // primary control structure
+    UDMA_USEBURSTCLR_R = 1 << DMA_CH_UART0TX;           // single and burst requests
+    UDMA_REQMASKCLR_R = 1 << DMA_CH_UART0TX;
+    return true;
+}
+
+// Baud rate error in ppm of divisor (r in units of 1/64) with clkDiv of 16 or 8 (HSE)
+int32_t baudErrorPpm(uint32_t baudRate, uint32_t fcyc, uint32_t divisorTimes64, uint8_t clkDiv)
+{
+    // actual / baudRate - 1, where actual = fcyc / (clkDiv * r)
+    return (int32_t)((int64_t)fcyc * 64 * 1000000 / ((int64_t)clkDiv * divisorTimes64 * baudRate)) - 1000000;
 }
 
-// Set baud rate as function of instruction cycle frequency
-void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc)
+// Set baud rate as function of instruction cycle frequency. Tries ClkDiv 16 and the
+// high-speed ClkDiv 8 (HSE) and programs whichever gets closest, preferring 16 on a tie
+// since it samples each bit more times. Returns the resulting baud error in ppm
+int32_t setUart0BaudRate(uint32_t baudRate, uint32_t fcyc)
 {
-    uint32_t divisorTimes128 = (fcyc * 8) / baudRate;   // calculate divisor (r) in units of 1/128,
-                                                        // where r = fcyc / 16 * baudRate
-    divisorTimes128 += 1;                               // add 1/128 to allow rounding
+    uint32_t div16 = ((uint64_t)fcyc * 4 + baudRate/2) / baudRate;         // r * 64 = fcyc * 64 / (16 * baudRate)
+    uint32_t div8  = ((uint64_t)fcyc * 8 + baudRate/2) / baudRate;         // r * 64 = fcyc * 64 / (8 * baudRate)
+    int32_t err16 = 0x7FFFFFFF, err8 = 0x7FFFFFFF;
+    uint32_t divisorTimes64;
+    bool hse;
+
+    if(div16 >= 64 && div16 < (65536 << 6))                                 // IBRD must be 1..65535
+        err16 = baudErrorPpm(baudRate, fcyc, div16, 16);
+    if(div8 >= 64 && div8 < (65536 << 6))
+        err8 = baudErrorPpm(baudRate, fcyc, div8, 8);
+
+    hse = (err8 < 0 ? -err8 : err8) < (err16 < 0 ? -err16 : err16);
+    divisorTimes64 = hse ? div8 : div16;
+
     UART0_CTL_R = 0;                                    // turn-off UART0 to allow safe programming
-    UART0_IBRD_R = divisorTimes128 >> 7;                // set integer value to floor(r)
-    UART0_FBRD_R = ((divisorTimes128) >> 1) & 63;       // set fractional value to round(fract(r)*64)
+    UART0_IBRD_R = divisorTimes64 >> 6;                 // set integer value to floor(r)
+    UART0_FBRD_R = divisorTimes64 & 63;                 // set fractional value to round(fract(r)*64)
     UART0_LCRH_R = UART_LCRH_WLEN_8 | UART_LCRH_FEN;    // configure for 8N1 w/ 16-level FIFO
-    UART0_CTL_R = UART_CTL_TXE | UART_CTL_RXE | UART_CTL_UARTEN;
+    UART0_CTL_R = UART_CTL_TXE | UART_CTL_RXE | UART_CTL_UARTEN | (hse ? UART_CTL_HSE : 0);
                                                         // turn-on UART0
+    return hse ? err8 : err16;
+}
+
+// Auto-baud: waits for one character ('U' or Enter work best, both have a single-bit
+// pulse) and measures the shortest time between edges on U0RX. PA0 has no timer CCP
+// function, so the pin is polled as GPIO against free-running TIMER1. The poll loop is a
+// handful of cycles, fine up to 230400 baud at 40 MHz; faster rates get snapped from a
+// coarser reading. Call from main() before the RTOS starts. Returns the standard rate set
+uint32_t autoBaudUart0(uint32_t fcyc)
+{
+    const uint32_t rates[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600};
+    uint32_t edge[AUTOBAUD_EDGES];
+    uint32_t bitTime = 0xFFFFFFFF;
+    uint32_t measured, best = 0, bestDiff = 0xFFFFFFFF, diff, last;
+    uint8_t i, n = 0;
+
+    SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R1;
+    _delay_cycles(3);
+    TIMER1_CTL_R &= ~TIMER_CTL_TAEN;
+    TIMER1_CFG_R = TIMER_CFG_32_BIT_TIMER;
+    TIMER1_TAMR_R = TIMER_TAMR_TAMR_PERIOD;             // down count, free running
+    TIMER1_TAILR_R = 0xFFFFFFFF;
+    TIMER1_IMR_R = 0;
+    TIMER1_CTL_R |= TIMER_CTL_TAEN;
+
+    GPIO_PORTA_AFSEL_R &= ~1;                           // U0RX back to plain GPIO input
+
+    while(GPIO_PORTA_DATA_R & 1);                       // idle high until the start bit
+    edge[n++] = TIMER1_TAV_R;
+    last = 0;
+    while(n < AUTOBAUD_EDGES) {                         // every following edge, give up once the line
+        while((GPIO_PORTA_DATA_R & 1) == last)          // stays put for ~10 ms (stop bit reached)
+            if(edge[n-1] - TIMER1_TAV_R > fcyc / 100)
+                break;
+        if((GPIO_PORTA_DATA_R & 1) == last)
+            break;
+        edge[n++] = TIMER1_TAV_R;
+        last ^= 1;
+    }
+
+    for(i=1; i<n; i++)                                  // shortest pulse = one bit
+        if(edge[i-1] - edge[i] < bitTime)
+            bitTime = edge[i-1] - edge[i];
+
+    GPIO_PORTA_AFSEL_R |= 1;
+    TIMER1_CTL_R &= ~TIMER_CTL_TAEN;
+
+    measured = (n > 1) ? fcyc / bitTime : 115200;
+    for(i=0; i<sizeof(rates)/sizeof(rates[0]); i++) {   // snap to the closest standard rate
+        diff = (measured > rates[i]) ? measured - rates[i] : rates[i] - measured;
+        if(diff < bestDiff) {
+            bestDiff = diff;
+            best = rates[i];
+        }
+    }
+
+    setUart0BaudRate(best, fcyc);
+    while(!(UART0_FR_R & UART_FR_RXFE))                 // drop whatever the UART made of the
+        UART0_DR_R;                                     // character while it was at the old rate
+    return best;
+}
+
+// True in handler mode or privileged thread mode (before RTOS start), where tasks' SVCs can't be used
+bool privilegedMode(void)
+{
+    return getIPSR() || !(getCONTROL() & 1);
+}
+
+// Program channel 9 for the queued block and hand the UART TX request over to the uDMA
+void uart0DmaStart(void)
+{
+    uint32_t *entry = dmaTable + DMA_CH_UART0TX*4;
+
+    entry[UDMA_SRCENDP/4] = (uint32_t)dmaSrc + dmaLength - 1;
+    entry[UDMA_DSTENDP/4] = (uint32_t)&UART0_DR_R;
+    entry[UDMA_CHCTL/4] = UDMA_CHCTL_DSTINC_NONE | UDMA_CHCTL_DSTSIZE_8 | UDMA_CHCTL_SRCINC_8 |
+                          UDMA_CHCTL_SRCSIZE_8 | UDMA_CHCTL_ARBSIZE_4 |
+                          ((dmaLength - 1) << UDMA_CHCTL_XFERSIZE_S) | UDMA_CHCTL_XFERMODE_BASIC;
+    dmaState = DMA_ACTIVE;
+    UDMA_ENASET_R = 1 << DMA_CH_UART0TX;
+    UART0_DMACTL_R |= UART_DMACTL_TXDMAE;
 }
 
-// Blocking function that writes a serial character when the UART buffer is not full
+// Block finished (channel disabled itself), release the writer waiting for the channel
+void uart0DmaDone(void)
+{
+    UDMA_CHIS_R = 1 << DMA_CH_UART0TX;
+    UART0_DMACTL_R &= ~UART_DMACTL_TXDMAE;
+    dmaState = DMA_IDLE;
+    if(dmaWaiting) {
+        dmaWaiting = false;
+        taskPostAll(uartDmaDone);
+    }
+}
+
+// Move as many bytes as fit from the TX ring into the hardware FIFO (privileged).
+// Stops at the mark of a queued block and starts the uDMA once everything before it is out
+void uart0TxKick(void)
+{
+    uint16_t end = (dmaState == DMA_IDLE) ? txHead : dmaMark;
+
+    while(txTail != end && !(UART0_FR_R & UART_FR_TXFF))
+        UART0_DR_R = txBuffer[txTail++ & (TX_BUFFER_SIZE-1)];
+
+    if(dmaState == DMA_PENDING && txTail == dmaMark)
+        uart0DmaStart();
+}
+
+// Polled flush of the ring and any uDMA block, in order, for privileged callers
+void uart0Drain(void)
+{
+    do {
+        while(txTail != ((dmaState == DMA_IDLE) ? txHead : dmaMark)) {
+            while (UART0_FR_R & UART_FR_TXFF);          // wait if uart0 tx fifo full
+            UART0_DR_R = txBuffer[txTail++ & (TX_BUFFER_SIZE-1)];
+        }
+        if(dmaState == DMA_PENDING)
+            uart0DmaStart();
+        if(dmaState == DMA_ACTIVE) {
+            while(UDMA_ENASET_R & (1 << DMA_CH_UART0TX));
+            uart0DmaDone();
+        }
+    } while(txTail != txHead);
+}
+
+// SVC side of putBlockUart0: queue len bytes at src (already checked to belong to the
+// caller) behind the bytes in the ring. Returns false if a block is already queued or
+// in flight, the caller is then blocked on uartDmaDone before the SVC returns
+bool writeDmaBlock(const void *src, uint16_t len)
+{
+    if(dmaState != DMA_IDLE) {
+        dmaWaiting = true;
+        taskBlock(uartDmaDone);
+        return false;
+    }
+
+    dmaSrc = src;
+    dmaLength = len;
+    dmaMark = txHead;
+    dmaState = DMA_PENDING;
+    uart0TxKick();
+    return true;
+}
+
+// SVC side of syncUart0Dma, blocks the caller on uartDmaDone while busy
+bool uart0DmaBusy(void)
+{
+    if(dmaState == DMA_IDLE)
+        return false;
+    dmaWaiting = true;
+    taskBlock(uartDmaDone);
+    return true;
+}
+
+// SVC side of putsUart0: copy what fits of str into the TX ring and start transmission.
+// The kernel passes the bytes the caller may read at str as max, the walk stops there.
+// Returns number of chars taken, if short the caller is blocked on uartTxFree
+uint16_t writeTxBuffer(const char *str, uint32_t max)
+{
+    uint16_t n = 0;
+
+    while(n < max && str[n] != 0 && (uint16_t)(txHead - txTail) < TX_BUFFER_SIZE)
+        txBuffer[txHead++ & (TX_BUFFER_SIZE-1)] = str[n++];
+
+    if(n < max && str[n] != 0) {
+        txWaiting = true;
+        taskBlock(uartTxFree);
+    }
+
+    uart0TxKick();
+    return n;
+}
+
+// Raw bytes into the TX ring (kernel callers that already checked txBufferFree)
+void writeTxBytes(const uint8_t *data, uint16_t len)
+{
+    while(len-- && (uint16_t)(txHead - txTail) < TX_BUFFER_SIZE)
+        txBuffer[txHead++ & (TX_BUFFER_SIZE-1)] = *data++;
+    uart0TxKick();
+}
+
+uint16_t txBufferFree(void)
+{
+    return TX_BUFFER_SIZE - (uint16_t)(txHead - txTail);
+}
+
+// SVC side of getcUart0: next received byte (0-255), -1 if none and the caller is then
+// blocked on uartRxReady
+int16_t readRxBuffer(void)
+{
+    if(rxTail == rxHead) {
+        rxWaiting = true;
+        taskBlock(uartRxReady);
+        return -1;
+    }
+    return (uint8_t)rxBuffer[rxTail++ & (RX_BUFFER_SIZE-1)];
+}
+
+// SVC side of readUart0Bulk: copy up to max chars, none blocks the caller on uartRxReady
+uint8_t readRxBytes(char *buf, uint8_t max)
+{
+    uint8_t n = 0;
+
+    while(n < max && rxTail != rxHead)
+        buf[n++] = rxBuffer[rxTail++ & (RX_BUFFER_SIZE-1)];
+    if(!n) {
+        rxWaiting = true;
+        taskBlock(uartRxReady);
+    }
+    return n;
+}
+
+// SVC side of kbhitUart0
+bool rxBufferEmpty(void)
+{
+    return rxTail == rxHead;
+}
+
+// UART0 RX/TX interrupt: fill RX ring from FIFO, refill TX FIFO from ring, wake blocked tasks
+void uart0Isr(void)
+{
+    char c;
+
+    TRACE(TR_ISR, getIPSR());
+
+    if(UART0_MIS_R & (UART_MIS_RXMIS | UART_MIS_RTMIS)) {
+        UART0_ICR_R = UART_ICR_RXIC | UART_ICR_RTIC;
+        while(!(UART0_FR_R & UART_FR_RXFE)) {
+            c = UART0_DR_R & 0xFF;
+            if((uint16_t)(rxHead - rxTail) < RX_BUFFER_SIZE)        // drop if ring is full
+                rxBuffer[rxHead++ & (RX_BUFFER_SIZE-1)] = c;
+        }
+        if(rxWaiting) {
+            rxWaiting = false;
+            taskPostAll(uartRxReady);
+        }
+    }
+
+    if(UDMA_CHIS_R & (1 << DMA_CH_UART0TX)) {                       // uDMA completion comes in on the UART vector
+        uart0DmaDone();
+        uart0TxKick();                                              // bytes queued behind the block
+    }
+
+    if(UART0_MIS_R & UART_MIS_TXMIS) {
+        UART0_ICR_R = UART_ICR_TXIC;
+        uart0TxKick();
+        if(txWaiting) {
+            txWaiting = false;
+            taskPostAll(uartTxFree);
+        }
+    }
+}
+
+// Writes a serial character, see putsUart0
 void putcUart0(char c)
 {
-    while (UART0_FR_R & UART_FR_TXFF);               // wait if uart0 tx fifo full
-    UART0_DR_R = c;                                  // write character to fifo
+    char str[2];
+    str[0] = c;
+    str[1] = 0;
+    putsUart0(str);
 }
 
-// Blocking function that writes a string when the UART buffer is not full
+// Writes a string through the TX ring. Tasks only block (on uartTxFree) when the ring is full.
+// Privileged callers (faults, kernel, main) drain the ring and write the FIFO directly
 void putsUart0(char* str)
 {
-    uint8_t i = 0;
+    uint32_t i = 0;
+
+    if(privilegedMode()) {
+        uart0Drain();
+        while (str[i] != '\0') {
+            while (UART0_FR_R & UART_FR_TXFF);          // wait if uart0 tx fifo full
+            UART0_DR_R = str[i++];                      // write character to fifo
+        }
+        return;
+    }
+
     while (str[i] != '\0')
-        putcUart0(str[i++]);
+        i += _writeUart0(&str[i]);                      // ring full, the SVC slept until the ISR drained it
+}
+
+// Sends len bytes with the uDMA, no CPU work per byte. Output stays in order with putsUart0.
+// Returns once the block is queued; data must stay untouched (and a handle block locked)
+// until syncUart0Dma() returns. Blocks larger than DMA_MAX_TRANSFER are sent in pieces
+void putBlockUart0(const void *data, uint16_t len)
+{
+    const uint8_t *p = data;
+    uint16_t n;
+    int8_t status;
+
+    if(privilegedMode()) {
+        uart0Drain();
+        while(len--) {
+            while (UART0_FR_R & UART_FR_TXFF);
+            UART0_DR_R = *p++;
+        }
+        return;
+    }
+
+    while(len) {
+        n = (len > DMA_MAX_TRANSFER) ? DMA_MAX_TRANSFER : len;
+        while((status = _writeUart0Dma(p, n)) == 0);    // channel busy, the SVC slept until it freed up
+        if(status < 0)
+            return;                                     // not the caller's memory
+        p += n;
+        len -= n;
+    }
+}
+
+// Sleeps until the uDMA channel is idle, after which the last block's buffer may be reused
+void syncUart0Dma(void)
+{
+    if(privilegedMode()) {
+        uart0Drain();
+        return;
+    }
+    while(_uart0DmaBusy());                             // each busy answer slept until uartDmaDone
 }
 
-// Blocking function that returns with serial data once the buffer is not empty
+// Buffered writer for long outputs: text is collected in one half of the block while the
+// other half is being sent by the uDMA. Writing through a 0 block falls back to putsUart0
+void openBlock(UART_BLOCK *out)
+{
+    out->length = 0;
+    out->active = 0;
+}
+
+void putsBlock(UART_BLOCK *out, const char *str)
+{
+    if(!out) {
+        putsUart0((char *)str);
+        return;
+    }
+
+    while(*str) {
+        if(out->length == UART_BLOCK_SIZE)
+            flushBlock(out);
+        out->buffer[out->active][out->length++] = *str++;
+    }
+}
+
+// Binary data (may hold zeros) into the block, 0 sends it straight out
+void putBytesBlock(UART_BLOCK *out, const void *data, uint16_t len)
+{
+    const uint8_t *p = data;
+
+    if(!out) {
+        putBlockUart0(data, len);
+        return;
+    }
+
+    while(len--) {
+        if(out->length == UART_BLOCK_SIZE)
+            flushBlock(out);
+        out->buffer[out->active][out->length++] = *p++;
+    }
+}
+
+// Queue the filled half and switch halves. Queuing only succeeds once the channel is idle,
+// so the other half is known to have been sent
+void flushBlock(UART_BLOCK *out)
+{
+    if(!out || !out->length)
+        return;
+
+    putBlockUart0(out->buffer[out->active], out->length);
+    out->active ^= 1;
+    out->length = 0;
+}
+
+// Flush and wait for the uDMA, the block (usually on the caller's stack) can then go away
+void closeBlock(UART_BLOCK *out)
+{
+    flushBlock(out);
+    syncUart0Dma();
+}
+
+// Returns a received character, tasks sleep on uartRxReady until one arrives
 char getcUart0(void)
 {
-    while (UART0_FR_R & UART_FR_RXFE);               // wait if uart0 rx fifo empty
-    return UART0_DR_R & 0xFF;                        // get character from fifo
+    int16_t c;
+
+    if(privilegedMode()) {
+        if(rxTail != rxHead)                            // ISR may already have buffered it
+            return rxBuffer[rxTail++ & (RX_BUFFER_SIZE-1)];
+        while (UART0_FR_R & UART_FR_RXFE);              // wait if uart0 rx fifo empty
+        return UART0_DR_R & 0xFF;                       // get character from fifo
+    }
+
+    while((c = _readUart0()) < 0);                      // empty, the SVC slept until uartRxReady
+    return c;
 }
 
 // Returns the status of the receive buffer
 bool kbhitUart0(void)
 {
-    return !(UART0_FR_R & UART_FR_RXFE);
+    if(privilegedMode())
+        return !rxBufferEmpty() || !(UART0_FR_R & UART_FR_RXFE);
+    return _kbhitUart0();
 }
 
 
@@ -111,35 +571,217 @@ bool strgcmp(char *str1, const char str2[]) {
     return 1;
 }
 
-void getsUart0(COMMAND_DATA *data) {
-    int count = 0;
+// Line editor: fed one character at a time, echoes, moves the cursor with the arrow keys
+// (VT100 CSI sequences), recalls the last HISTORY_SIZE lines with up/down and beeps instead
+// of dropping characters once the line is full. Lives on the caller's stack
+void initLineEditor(LINE_EDITOR *ed) {
+    ed->length = ed->cursor = 0;
+    ed->state = ED_NORMAL;
+    ed->lastCr = false;
+    ed->historyCount = 0;
+    ed->historyNewest = 0;
+    ed->historyPos = -1;
+    ed->echoLength = 0;
+    ed->pendingCount = ed->pendingPos = 0;
+}
+
+void edFlush(LINE_EDITOR *ed) {
+    if(ed->echoLength) {
+        ed->echo[ed->echoLength] = 0;
+        putsUart0(ed->echo);
+        ed->echoLength = 0;
+    }
+}
+
+void edEcho(LINE_EDITOR *ed, const char *str) {
+    while(*str) {
+        if(ed->echoLength == ED_ECHO_SIZE)
+            edFlush(ed);
+        ed->echo[ed->echoLength++] = *str++;
+    }
+}
+
+// Move the terminal cursor n columns, dir is 'C' (right) or 'D' (left)
+void edMove(LINE_EDITOR *ed, uint8_t n, char dir) {
+    char str[8];
+    if(!n)
+        return;
+    edEcho(ed, "\033[");
+    fmtUint(str, n, 0, ' ');
+    edEcho(ed, str);
+    str[0] = dir;
+    str[1] = 0;
+    edEcho(ed, str);
+}
+
+// Reprint the line from the cursor to the end, clear what is left, put the cursor back
+void edRedrawTail(LINE_EDITOR *ed) {
+    ed->line[ed->length] = 0;
+    edEcho(ed, &ed->line[ed->cursor]);
+    edEcho(ed, "\033[K");
+    edMove(ed, ed->length - ed->cursor, 'D');
+}
+
+// Replace the whole line (history recall)
+void edReplace(LINE_EDITOR *ed, const char *str) {
+    edMove(ed, ed->cursor, 'D');
+    strgcopy(ed->line, str);
+    for(ed->length=0; ed->line[ed->length]; ed->length++);
+    ed->cursor = 0;
+    edRedrawTail(ed);
+    edMove(ed, ed->length, 'C');
+    ed->cursor = ed->length;
+}
+
+void edHistory(LINE_EDITOR *ed, int8_t step) {
+    int8_t pos = ed->historyPos + step;
+
+    if(pos >= ed->historyCount || pos < -1)
+        return;
+    ed->historyPos = pos;
+    if(pos == -1)
+        edReplace(ed, "");
+    else
+        edReplace(ed, ed->history[(ed->historyNewest + HISTORY_SIZE - pos) % HISTORY_SIZE]);
+}
+
+// Feed one character, returns true when Enter completes the line (in ed->line)
+bool lineEditorFeed(LINE_EDITOR *ed, char c) {
+    uint8_t i;
+    char str[2];
 
-    while(1) {
-        if(!kbhitUart0()) {
-            yield();
-            continue;
+    if(ed->state == ED_ESC) {                                       // ESC seen, expect [
+        ed->state = (c == '[') ? ED_CSI : ED_NORMAL;
+        ed->param = 0;
+        return false;
+    }
+    if(ed->state == ED_CSI) {
+        if(c >= '0' && c <= '9') {                                  // numeric parameter (3~ delete)
+            ed->param = ed->param*10 + c - '0';
+            return false;
         }
-        char c = getcUart0();
+        ed->state = ED_NORMAL;
+        switch(c) {
+            case 'A': edHistory(ed, 1); break;
+            case 'B': edHistory(ed, -1); break;
+            case 'C':
+                if(ed->cursor < ed->length) {
+                    ed->cursor++;
+                    edEcho(ed, "\033[C");
+                }
+                break;
+            case 'D':
+                if(ed->cursor > 0) {
+                    ed->cursor--;
+                    edEcho(ed, "\033[D");
+                }
+                break;
+            case 'H':
+                edMove(ed, ed->cursor, 'D');
+                ed->cursor = 0;
+                break;
+            case 'F':
+                edMove(ed, ed->length - ed->cursor, 'C');
+                ed->cursor = ed->length;
+                break;
+            case '~':
+                if(ed->param == 3 && ed->cursor < ed->length) {    // delete under cursor
+                    for(i=ed->cursor; i<ed->length-1; i++)
+                        ed->line[i] = ed->line[i+1];
+                    ed->length--;
+                    edRedrawTail(ed);
+                }
+                break;
+        }
+        return false;
+    }
 
-        if( (c == 8 || c == 127 ) && (count > 0) ) {    // if backspace decrement count
-            count--;
+    if(c == '\n' && ed->lastCr) {                                   // CR LF counts once
+        ed->lastCr = false;
+        return false;
+    }
+    ed->lastCr = (c == '\r');
+
+    if(c == '\r' || c == '\n') {
+        ed->line[ed->length] = 0;
+        edEcho(ed, "\n");
+        if(ed->length && (ed->historyCount == 0 ||
+           strgorder(ed->line, ed->history[ed->historyNewest]) != 0)) {
+            ed->historyNewest = (ed->historyNewest + 1) % HISTORY_SIZE;
+            strgcopy(ed->history[ed->historyNewest], ed->line);
+            if(ed->historyCount < HISTORY_SIZE)
+                ed->historyCount++;
         }
-        else if ( c == 13 ) {                         // if new line (Enter key) is entered, return
-            data->buffer[count] = 0;
-            return;
+        ed->historyPos = -1;
+        return true;
+    }
+    else if(c == 27) {
+        ed->state = ED_ESC;
+    }
+    else if(c == 8 || c == 127) {                                   // backspace
+        if(ed->cursor > 0) {
+            for(i=ed->cursor-1; i<ed->length-1; i++)
+                ed->line[i] = ed->line[i+1];
+            ed->length--;
+            ed->cursor--;
+            edEcho(ed, "\b");
+            edRedrawTail(ed);
+        }
+    }
+    else if(c >= 32 && c < 127) {                                   // printable, insert at cursor
+        if(ed->length >= MAX_CHARS) {
+            edEcho(ed, "\a");                                       // full, beep rather than drop silently
+            return false;
         }
-        else if( c >= 32) {                           // Any printable characters, keep in buffer
-            data->buffer[count] = c;
-            count++;
+        for(i=ed->length; i>ed->cursor; i--)
+            ed->line[i] = ed->line[i-1];
+        ed->line[ed->cursor] = c;
+        ed->length++;
+        if(ed->cursor == ed->length-1) {                            // appending, just echo
+            str[0] = c;
+            str[1] = 0;
+            edEcho(ed, str);
+            ed->cursor++;
+        }
+        else {
+            edRedrawTail(ed);
+            edMove(ed, 1, 'C');
+            ed->cursor++;
+        }
+    }
+    return false;
+}
 
-            if(count>=MAX_CHARS) {
-                data->buffer[count] = 0;
-                return;
-            }
+// Reads a line through the editor. Characters arrive from the RX ring in bulk, what is
+// left after Enter (pasted batches) stays pending for the next call. Sleeps on uartRxReady
+void getsUart0(LINE_EDITOR *ed, COMMAND_DATA *data) {
+    bool done = false;
+
+    ed->length = ed->cursor = 0;
+    while(!done) {
+        if(ed->pendingPos == ed->pendingCount) {
+            edFlush(ed);
+            ed->pendingCount = readUart0Bulk(ed->pending, ED_PENDING_SIZE);
+            ed->pendingPos = 0;
         }
+        while(!done && ed->pendingPos < ed->pendingCount)
+            done = lineEditorFeed(ed, ed->pending[ed->pendingPos++]);
     }
+    edFlush(ed);
+    strgcopy(data->buffer, ed->line);
 }
 
+// Up to max received chars into buf, at least one (sleeps on uartRxReady inside the SVC)
+uint8_t readUart0Bulk(char *buf, uint8_t max) {
+    uint8_t n;
+
+    if(privilegedMode()) {
+        buf[0] = getcUart0();
+        return 1;
+    }
+    while((n = _readUart0Bulk(buf, max)) == 0);         // empty, the SVC slept until uartRxReady
+    return n;
+}
 
 void parseFields(COMMAND_DATA *data) {
     // Numeric 48-57
@@ -192,6 +834,14 @@ void parseFields(COMMAND_DATA *data) {
     return;
 }
 
+// strcmp style order of two strings: <0, 0 or >0
+int8_t strgorder(const char str1[], const char str2[]) {
+    uint32_t i = 0;
+    while(str1[i] != 0 && str1[i] == str2[i])
+        i++;
+    return (str1[i] > str2[i]) - (str1[i] < str2[i]);
+}
+
 char* getFieldString(COMMAND_DATA* data, uint8_t fieldNumber) {
 
     if(fieldNumber < data->fieldCount) {
@@ -274,40 +924,12 @@ bool isCommand(COMMAND_DATA* data, const char strCommand[], uint8_t minArguments
     return 0;
 }
 
+// Decimal, or hex zero padded to hexLen digits. See fmt.c
 void itos(uint32_t num, char *str, bool hex, uint8_t hexLen) {
-
-    uint32_t temp = num;
-    uint32_t len = 0;
-
-    if(num == 0) len++;                     // 0 unique case
-
-    if(!hex) {                              // Binary
-
-        while(temp != 0) {                  // get number of digits in num
-            temp = temp/10;
-            len++;
-        }
-
-        str[len] = 0;                       // NULL at end of str
-
-        while(len != 0) {
-            str[len-1] = num % 10 + 48;     // convert each digit and add 48
-            num = num/10;
-            len--;
-        }
-    }
-    else {                                                      // HEX
-        len = hexLen;                                           // set length
-
-        str[len] = 0;
-
-        while(len != 0) {
-           if((num % 16) < 10 ) str[len-1] = num % 16 + 48;     // if between 0-9 add 48
-           else str[len-1] = num % 16 + 55;                     // above, add 65-10 = 55
-           num = num/16;
-           len--;
-        }
-    }
+    if(hex)
+        fmtHex(str, num, hexLen);
+    else
+        fmtUint(str, num, 0, ' ');
 }
 
 void strgcopy(char *dest, const char source[]) {
@@ -320,168 +942,202 @@ void strgcopy(char *dest, const char source[]) {
 }
 
 void display(char* txt, uint32_t n, bool hex, uint8_t len) {
+    displayBlock(0, txt, n, hex, len);
+}
+
+void displayBlock(UART_BLOCK *out, char* txt, uint32_t n, bool hex, uint8_t len) {
     char str[10] = {0};
     itos(n, str, hex, len);
-    putsUart0(txt);
-    putsUart0(str);
-    putsUart0("\n");
+    putsBlock(out, txt);
+    putsBlock(out, str);
+    putsBlock(out, "\n");
 }
 
 void putsPidKilled(uint32_t pid) {
     char str[20];
-    itos(pid, str, 1, 4);
+    fmtHex(str, pid, 4);
     putsUart0("0x");
     putsUart0(str);
     putsUart0(" killed\n\n");
 }
 
-void printPS(char *name, uint32_t pid, uint16_t cpu, uint8_t state, uint8_t sem, uint8_t mtx) {
+void printPS(UART_BLOCK *out, char *name, uint32_t pid, uint16_t cpu, uint16_t spDepth, uint16_t spPeak,
+             uint16_t spFree, uint8_t state, uint8_t sem, uint8_t mtx) {
     char str[15];
     uint8_t i = 0;
-    uint16_t cpu1 = cpu;
-    uint16_t cpu2 = cpu;
 
     // Name
     while(name[i] != 0) i++;
-    putsUart0(name);
-    if(i<8) putsUart0("\t\t");
-    else putsUart0("\t");
+    putsBlock(out, name);
+    if(i<8) putsBlock(out, "\t\t");
+    else putsBlock(out, "\t");
 
     // PID
-    itos(pid, str, 1, 4);
-    putsUart0("0x");
-    putsUart0(str);
-    putsUart0("\t ");
-
-    // %CPU
-    cpu1 /= 100;    // Upper 2 digits
-    cpu2 %= 100;    // Lower 2 digits
-
-    itos(cpu1, str, 0, 0);
-    putsUart0(str);
-    putsUart0(".");
-    itos(cpu2, str, 0, 0);
-    if(cpu2 < 10) putsUart0("0");
-    putsUart0(str);
-    putsUart0("%");
-    putsUart0("\t");
+    fmtHex(str, pid, 4);
+    putsBlock(out, "0x");
+    putsBlock(out, str);
+    putsBlock(out, "\t ");
+
+    // %CPU, hundredths of a percent
+    fmtFixed(str, cpu, 2, 0);
+    putsBlock(out, str);
+    putsBlock(out, "%");
+    putsBlock(out, "\t ");
+
+    // Stack: current depth, peak & headroom (bytes)
+    fmtUint(str, spDepth, 0, ' ');
+    putsBlock(out, str);
+    putsBlock(out, "\t");
+    fmtUint(str, spPeak, 0, ' ');
+    putsBlock(out, str);
+    putsBlock(out, "\t");
+    fmtUint(str, spFree, 0, ' ');
+    putsBlock(out, str);
+    putsBlock(out, "\t");
 
     // STATE
     switch(state) {
         case 0:
-            putsUart0("  Invalid\n");
+            putsBlock(out, "  Invalid\n");
             break;
         case 1:
-            putsUart0("  Stopped\n");
+            putsBlock(out, "  Stopped\n");
             break;
         case 2:
-            putsUart0("  Ready\n");
+            putsBlock(out, "  Ready\n");
             break;
         case 3:
-            putsUart0("  Delayed\n");
+            putsBlock(out, "  Delayed\n");
             break;
         case 4:
-            putsUart0("  B-Mutex          ");
-            itos(mtx, str, 0, 0);
-            putsUart0(str);
-            putsUart0("\n");
+            putsBlock(out, "  B-Mutex          ");
+            fmtUint(str, mtx, 0, ' ');
+            putsBlock(out, str);
+            putsBlock(out, "\n");
             break;
         case 5:
-            putsUart0("  B-Semaph    ");
-            itos(sem, str, 0, 0);
-            putsUart0(str);
-            putsUart0("\n");
+            putsBlock(out, "  B-Semaph    ");
+            fmtUint(str, sem, 0, ' ');
+            putsBlock(out, str);
+            putsBlock(out, "\n");
             break;
         default:
-            putsUart0("should NOT get here\n");
+            putsBlock(out, "should NOT get here\n");
             break;
     }
 }
 
-void printMem(uint32_t pid, uint32_t baseAdd, uint16_t size) {
+// ps -v row: switch counts, ms spent ready/delayed/blocked and the worst READY to RUNNING
+// time in cycles, each right aligned in 9 chars
+void printPSv(UART_BLOCK *out, char *name, uint32_t pid, uint32_t counts[], uint8_t n) {
     char str[15];
+    uint8_t i = 0;
+
+    // Name
+    while(name[i] != 0) i++;
+    putsBlock(out, name);
+    if(i<8) putsBlock(out, "\t\t");
+    else putsBlock(out, "\t");
 
     // PID
-    itos(pid, str, 1, 4);
-    putsUart0("0x");
-    putsUart0(str);
-    putsUart0("\t\t");
+    fmtHex(str, pid, 4);
+    putsBlock(out, "0x");
+    putsBlock(out, str);
+
+    for(i=0; i<n; i++) {
+        fmtUint(str, counts[i], 9, ' ');
+        putsBlock(out, str);
+    }
+    putsBlock(out, "\n");
+}
+
+void printMem(UART_BLOCK *out, uint32_t pid, uint32_t baseAdd, uint16_t size) {
+    char str[15];
+
+    // PID
+    fmtHex(str, pid, 4);
+    putsBlock(out, "0x");
+    putsBlock(out, str);
+    putsBlock(out, "\t\t");
 
 
     // Base Address
-    itos(baseAdd, str, 1, 8);
-    putsUart0("0x");
-    putsUart0(str);
-    putsUart0("\t");
+    fmtHex(str, baseAdd, 8);
+    putsBlock(out, "0x");
+    putsBlock(out, str);
+    putsBlock(out, "\t");
 
     // Size
-    itos(size, str, 0, 0);
-    putsUart0(str);
-    putsUart0("\n");
+    fmtUint(str, size, 0, ' ');
+    putsBlock(out, str);
+    putsBlock(out, "\n");
 }
 
-void printSem(uint8_t sema, uint8_t count, uint8_t qSize, uint32_t q[]) {
+void printSem(UART_BLOCK *out, uint8_t sema, uint8_t count, uint8_t qSize, uint32_t q[]) {
     char str[15];
     uint8_t i;
 
     // Semaphore #
-    itos(sema, str, 0, 0);
-    putsUart0(str);
-    putsUart0("\t\t");
+    fmtUint(str, sema, 0, ' ');
+    putsBlock(out, str);
+    putsBlock(out, "\t\t");
 
     // Count
-    itos(count, str, 0, 0);
-    putsUart0(str);
-    putsUart0("\t\t");
+    fmtUint(str, count, 0, ' ');
+    putsBlock(out, str);
+    putsBlock(out, "\t\t");
 
     // Queue Size
-    itos(qSize, str, 0, 0);
-    putsUart0(str);
-    putsUart0("\t");
+    fmtUint(str, qSize, 0, ' ');
+    putsBlock(out, str);
+    putsBlock(out, "\t");
 
     // Queue
     for(i=0; i<qSize; i++) {
-        itos(q[i], str, 1, 4);
-        putsUart0("0x");
-        putsUart0(str);
+        fmtHex(str, q[i], 4);
+        putsBlock(out, "0x");
+        putsBlock(out, str);
     }
 
-    putsUart0("\n");
+    putsBlock(out, "\n");
 }
 
 
-void printMtx(uint8_t mtx, bool locked, uint32_t lockBy, uint8_t qSize, uint32_t q[]) {
+void printMtx(UART_BLOCK *out, uint8_t mtx, bool locked, uint32_t lockBy, uint8_t qSize, uint32_t q[]) {
     char str[15];
     uint8_t i = 0;
 
     // Mutex
-    itos(mtx, str, 0, 0);
-    putsUart0(str);
-    putsUart0("\t");
+    fmtUint(str, mtx, 0, ' ');
+    putsBlock(out, str);
+    putsBlock(out, "\t");
 
     // Locked
-    if(locked) putsUart0("Locked\t");
-    else putsUart0("Unlocked\t");
-
-    // Locked by
-    itos(lockBy, str, 1, 4);
-    putsUart0("0x");
-    putsUart0(str);
-    putsUart0("\t\t");
+    if(locked) putsBlock(out, "Locked\t");
+    else putsBlock(out, "Unlocked\t");
+
+    // Locked by, nobody while unlocked
+    if(locked) {
+        fmtHex(str, lockBy, 4);
+        putsBlock(out, "0x");
+        putsBlock(out, str);
+        putsBlock(out, "\t\t");
+    }
+    else putsBlock(out, "-\t\t");
 
     // Queue Size
-    itos(qSize, str, 0, 0);
-    putsUart0(str);
-    putsUart0("\t");
+    fmtUint(str, qSize, 0, ' ');
+    putsBlock(out, str);
+    putsBlock(out, "\t");
 
     // Queue
     for(i=0; i<qSize; i++) {
-        itos(q[i], str, 1, 4);
-        putsUart0("0x");
-        putsUart0(str);
+        fmtHex(str, q[i], 4);
+        putsBlock(out, "0x");
+        putsBlock(out, str);
     }
 
-    putsUart0("\n");
+    putsBlock(out, "\n");
 }
 
 
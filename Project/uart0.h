@@ -30,6 +30,13 @@
 
 #define MAX_CHARS 80
 #define MAX_FIELDS 6
+#define UART_BLOCK_SIZE 256
+
+typedef struct _UART_BLOCK {
+    char buffer[2][UART_BLOCK_SIZE];    // one half fills while the uDMA sends the other
+    uint16_t length;
+    uint8_t active;
+} UART_BLOCK;
 
 typedef struct _COMMAND_DATA {
     char buffer[MAX_CHARS+1];
@@ -38,27 +45,85 @@ typedef struct _COMMAND_DATA {
     char fieldType[MAX_FIELDS];
 } COMMAND_DATA;
 
+#define HISTORY_SIZE    4
+#define ED_ECHO_SIZE    32
+#define ED_PENDING_SIZE 16
+#define ED_NORMAL       0
+#define ED_ESC          1
+#define ED_CSI          2
+
+typedef struct _LINE_EDITOR {
+    char line[MAX_CHARS+1];
+    uint8_t length;
+    uint8_t cursor;
+    uint8_t state;                          // ED_ escape sequence state
+    uint8_t param;                          // CSI numeric parameter
+    bool lastCr;
+    char history[HISTORY_SIZE][MAX_CHARS+1];
+    uint8_t historyCount;
+    uint8_t historyNewest;
+    int8_t historyPos;                      // -1 editing a new line, else age of the entry shown
+    char echo[ED_ECHO_SIZE+1];              // echo is sent once per batch of input
+    uint8_t echoLength;
+    char pending[ED_PENDING_SIZE];          // received but not yet fed
+    uint8_t pendingCount;
+    uint8_t pendingPos;
+} LINE_EDITOR;
+
 void initUart0();
-void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc);
+int32_t baudErrorPpm(uint32_t baudRate, uint32_t fcyc, uint32_t divisorTimes64, uint8_t clkDiv);
+int32_t setUart0BaudRate(uint32_t baudRate, uint32_t fcyc);
+uint32_t autoBaudUart0(uint32_t fcyc);
 void putcUart0(char c);
 void putsUart0(char* str);
 char getcUart0();
 bool kbhitUart0();
 
-void getsUart0(COMMAND_DATA *data);
+bool privilegedMode(void);
+void uart0TxKick(void);
+uint16_t writeTxBuffer(const char *str, uint32_t max);
+int16_t readRxBuffer(void);
+void writeTxBytes(const uint8_t *data, uint16_t len);
+uint16_t txBufferFree(void);
+bool rxBufferEmpty(void);
+void uart0Isr(void);
+
+bool initUart0Dma(void);
+void uart0DmaStart(void);
+void uart0DmaDone(void);
+void uart0Drain(void);
+bool writeDmaBlock(const void *src, uint16_t len);
+bool uart0DmaBusy(void);
+void putBlockUart0(const void *data, uint16_t len);
+void syncUart0Dma(void);
+void openBlock(UART_BLOCK *out);
+void putsBlock(UART_BLOCK *out, const char *str);
+void putBytesBlock(UART_BLOCK *out, const void *data, uint16_t len);
+void flushBlock(UART_BLOCK *out);
+void closeBlock(UART_BLOCK *out);
+
+void initLineEditor(LINE_EDITOR *ed);
+bool lineEditorFeed(LINE_EDITOR *ed, char c);
+void getsUart0(LINE_EDITOR *ed, COMMAND_DATA *data);
+uint8_t readUart0Bulk(char *buf, uint8_t max);
+uint8_t readRxBytes(char *buf, uint8_t max);
 void parseFields(COMMAND_DATA *data);
 char* getFieldString(COMMAND_DATA* data, uint8_t fieldNumber);
 int32_t getFieldInteger(COMMAND_DATA* data, uint8_t fieldNumber);
 bool isCommand(COMMAND_DATA* data, const char strCommand[],uint8_t minArguments);
 bool strgcmp(char *str1, const char str2[]);
+int8_t strgorder(const char str1[], const char str2[]);
 void itos(uint32_t num, char *str, bool hex, uint8_t hexLen);
 void strgcopy(char *dest, const char source[]);
 
 void display(char* txt, uint32_t n, bool hex, uint8_t len);
+void displayBlock(UART_BLOCK *out, char* txt, uint32_t n, bool hex, uint8_t len);
 void putsPidKilled(uint32_t pid);
-void printPS(char *name, uint32_t pid, uint16_t cpu, uint8_t state, uint8_t sem, uint8_t mtx);
-void printMem(uint32_t pid, uint32_t baseAdd, uint16_t size);
-void printSem(uint8_t sema, uint8_t count, uint8_t qSize, uint32_t q[]);
-void printMtx(uint8_t mtx, bool locked, uint32_t lockBy, uint8_t qSize, uint32_t q[]);
+void printPS(UART_BLOCK *out, char *name, uint32_t pid, uint16_t cpu, uint16_t spDepth, uint16_t spPeak,
+             uint16_t spFree, uint8_t state, uint8_t sem, uint8_t mtx);
+void printPSv(UART_BLOCK *out, char *name, uint32_t pid, uint32_t counts[], uint8_t n);
+void printMem(UART_BLOCK *out, uint32_t pid, uint32_t baseAdd, uint16_t size);
+void printSem(UART_BLOCK *out, uint8_t sema, uint8_t count, uint8_t qSize, uint32_t q[]);
+void printMtx(UART_BLOCK *out, uint8_t mtx, bool locked, uint32_t lockBy, uint8_t qSize, uint32_t q[]);
 
 #endif
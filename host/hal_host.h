@@ -0,0 +1,66 @@
+// Host simulation register map
+// J Losh
+
+// Included by Project/hal.h when HOST_SIM is defined, after tm4c123gh6pm.h, so the bit
+// definitions stay and only the registers the kernel touches are redirected into the
+// simulator (sim.c). Everything else in the device header must not be used by a file
+// built for the host.
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+#include <stdint.h>
+
+// Core registers are plain variables, the simulator acts on the bits the kernel sets
+extern volatile uint32_t simIntCtrl, simApint, simFaultStat, simDbgInt, simDwtCtrl;
+extern volatile uint32_t simStCtrl, simStReload, simStCurrent;
+extern volatile uint32_t simMpuNumber, simMpuBase[8], simMpuAttr[8];
+extern volatile uint32_t simWt2Ctrl, simWt2Icr;
+uint32_t *simCycles(void);
+uint32_t *simTimer(void);
+
+#undef NVIC_INT_CTRL_R
+#undef NVIC_APINT_R
+#undef NVIC_FAULT_STAT_R
+#undef NVIC_DBG_INT_R
+#undef NVIC_ST_CTRL_R
+#undef NVIC_ST_RELOAD_R
+#undef NVIC_ST_CURRENT_R
+#undef NVIC_MPU_NUMBER_R
+#undef NVIC_MPU_BASE_R
+#undef NVIC_MPU_ATTR_R
+#undef TIMER2_TAV_R
+#undef WTIMER2_CTL_R
+#undef WTIMER2_ICR_R
+#undef DWT_CTRL_R
+#undef DWT_CYCCNT_R
+
+#define NVIC_INT_CTRL_R     simIntCtrl
+#define NVIC_APINT_R        simApint
+#define NVIC_FAULT_STAT_R   simFaultStat
+#define NVIC_DBG_INT_R      simDbgInt
+#define NVIC_ST_CTRL_R      simStCtrl
+#define NVIC_ST_RELOAD_R    simStReload
+#define NVIC_ST_CURRENT_R   simStCurrent
+#define NVIC_MPU_NUMBER_R   simMpuNumber
+#define NVIC_MPU_BASE_R     simMpuBase[simMpuNumber & 7]     // region selected by NUMBER
+#define NVIC_MPU_ATTR_R     simMpuAttr[simMpuNumber & 7]
+#define TIMER2_TAV_R        (*simTimer())                   // LOG_TIME, 40 MHz up count
+#define WTIMER2_CTL_R       simWt2Ctrl                      // profiler, never fires
+#define WTIMER2_ICR_R       simWt2Icr
+#define DWT_CTRL_R          simDwtCtrl
+#define DWT_CYCCNT_R        (*simCycles())                  // host clock in 40 MHz cycles
+
+// Thread mode code traps into the simulator at SVC, with its first four arguments still
+// in the argument registers as R0-R3 are on the target. The SVC text goes along in R11
+#define __asm(x)                                                        \
+    __asm__ volatile("leaq 1f(%%rip), %%r11\n\t"                        \
+                     "call simSvcEntry\n\t"                             \
+                     ".pushsection .rodata.simsvc, \"a\"\n"             \
+                     "1: .asciz \"" x "\"\n\t"                          \
+                     ".popsection" ::: "r11", "memory", "cc")
+
+// pendSvIsr is naked on the target, the simulator calls it like any function
+#define naked               used
+
+#endif
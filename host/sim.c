@@ -0,0 +1,515 @@
+// Host simulation of the TM4C123 core for the RTOS kernel
+// J Losh
+
+// Runs the unmodified kernel (Project/kernel.c, mm.c, stats.c, trace.c) as a Linux
+// process so scheduler and allocator changes can be fuzzed and benchmarked at host speed.
+//
+//   SRAM      0x20000000-0x20007FFF is mmap'd at its target address, so the heap, stacks
+//             and every address the kernel computes are the real ones
+//   Tasks     each runs on a ucontext with its own 64 KiB host stack; the simulated PSP
+//             still walks the task's heap stack, exception frames and all, so tcb sp,
+//             SVC arguments and the stack paint behave as on the target
+//   SVC       the wrappers' SVC traps into simSvc with R0-R3 taken from the argument
+//             registers, PendSV runs when pended before "returning from the exception"
+//   SysTick   a 1 ms ITIMER_REAL signal, deferred while the kernel runs (all handlers
+//             share one priority on the target, so none can interrupt another)
+//   MPU       registers are variables; simMpuAllows() evaluates the regions and SRD bits
+//             the way the hardware does. Subregions are 512 bytes, smaller than a page, so
+//             this is a check the caller makes rather than an mprotect fault
+//   UART, log stdout and no-ops, but UART0 TX timing is modeled at 115200 baud for the
+//             uart scenarios (simUartPutc, writeTxBuffer)
+//
+// Not modeled: fault exceptions, the uDMA and peripherals (WTIMER2 never fires, so the
+// profiler takes no samples), and SVCs whose pointer
+// argument must pass sramAccessible (task locals live on the host stack, outside any SRD
+// window) fail just as they would for a buffer outside the task's memory.
+//
+// Build (needs x86-64, fixed low addresses and no red zone under the SVC call), one command:
+//   gcc -O1 -fno-pie -no-pie -mno-red-zone -fno-inline -DHOST_SIM -I../Project -I.
+//       -Wno-int-to-pointer-cast -Wno-pointer-to-int-cast -Wno-implicit-int
+//       -o simbench simbench.c sim.c ../Project/kernel.c ../Project/mm.c
+//       ../Project/stats.c ../Project/trace.c ../Project/fmt.c ../Project/bench.c
+//       ../Project/heapbench.c ../Project/prof.c
+
+#define _GNU_SOURCE
+#define sleep libcSleep                     // the kernel has its own sleep()
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#undef sleep
+
+#include "hal.h"
+#include "kernel.h"
+#include "uart0.h"
+#include "log.h"
+#include "sim.h"
+
+#define SIM_SRAM_BASE   0x20000000
+#define SIM_SRAM_SIZE   0x8000
+#define SIM_SVC_TABLE   0x20000000          // n, 0xDF per SVC number, the PC the kernel decodes
+#define SIM_STACK       0x10000
+#define SIM_MAIN        0xFF                // simRunning before the first task
+#define SIM_FIRST_R12   0x0000000C          // initThreadStack's R12, no frame the simulator builds has it
+
+#define IPSR_SVCALL     11
+#define IPSR_PENDSV     14
+#define IPSR_SYSTICK    15
+#define IPSR_UART0      21
+
+extern uint8_t taskCurrent;
+
+// Registers, see hal_host.h
+volatile uint32_t simIntCtrl, simApint, simFaultStat, simDbgInt, simDwtCtrl;
+volatile uint32_t simStCtrl, simStReload, simStCurrent;
+volatile uint32_t simMpuNumber, simMpuBase[8], simMpuAttr[8];
+volatile uint32_t simWt2Ctrl, simWt2Icr;
+
+static uint32_t *simPsp;
+static uint32_t simIpsr;
+static uint32_t simControl;
+static uint32_t simR0[MAX_TASKS];
+
+static ucontext_t taskCtx[MAX_TASKS], mainCtx;
+static bool taskStarted[MAX_TASKS];
+static uint8_t simRunning = SIM_MAIN;       // task whose host context is executing
+static uint8_t simFrom;                     // task PendSV is saving
+
+static volatile sig_atomic_t simInKernel = 0;
+static volatile sig_atomic_t simTickPending = 0;
+static uint32_t simNextTick;                // cycles the next SysTick is due at
+static uint32_t simTickDue;                 // when the oldest pending SysTick was raised
+
+static void simUartIsr(void);
+
+uint64_t simSvcCount = 0;
+uint64_t simSwitchCount = 0;
+
+//-----------------------------------------------------------------------------
+// Clocks
+//-----------------------------------------------------------------------------
+
+uint32_t *simCycles(void)
+{
+    static uint32_t cycles;
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    cycles = (uint32_t)((uint64_t)ts.tv_sec * 40000000 + ts.tv_nsec / 25);
+    return &cycles;
+}
+
+uint32_t *simTimer(void)
+{
+    return simCycles();
+}
+
+//-----------------------------------------------------------------------------
+// asp.s
+//-----------------------------------------------------------------------------
+
+void setPSP(uint32_t *add)      { simPsp = add; }
+void setASP()                   { }
+int setTMPL()                   { simControl |= 1; return 0; }
+uint32_t *getPSP()              { return simPsp; }
+uint32_t *getMSP()              { return 0; }
+uint32_t getIPSR()              { return simIpsr; }
+uint32_t getCONTROL()           { return simControl; }
+uint32_t getR0()                { return simR0[simRunning == SIM_MAIN ? 0 : simRunning]; }
+
+uint32_t countLeadingZeros(uint32_t value)
+{
+    return value ? __builtin_clz(value) : 32;
+}
+
+// R4-R11 and LR go below the exception frame, their values do not matter here
+void pushRegsOnPSP()
+{
+    simFrom = simRunning;
+    simPsp -= 9;
+}
+
+// First run of a task: "return from the exception" into the frame initThreadStack built,
+// fn gets R0 and returns to LR (threadExit)
+static void simTaskEntry(void)
+{
+    uint32_t *frame = simPsp;
+    void (*fn)(void *) = (void (*)(void *))(uintptr_t)frame[6];
+    void (*ret)(void) = (void (*)(void))(uintptr_t)frame[5];
+    void *arg = (void *)(uintptr_t)frame[0];
+
+    frame[4] = 0;                           // consumed, a later frame here is not a first one
+    simPsp += 8;
+    simControl |= 1;
+    simIpsr = 0;
+    simInKernel = 0;
+    fn(arg);
+    ret();
+
+    fprintf(stderr, "sim: task %u ran on after threadExit\n", simRunning);
+    exit(3);
+}
+
+// The switch itself: the host context of the task the kernel just picked
+void popRegsOnPSP()
+{
+    uint8_t to = taskCurrent;
+    ucontext_t *from;
+
+    simPsp += 9;
+    if(to == simRunning)
+        return;
+
+    from = simRunning == SIM_MAIN ? &mainCtx : &taskCtx[simRunning];
+    if(!taskStarted[to] || simPsp[4] == SIM_FIRST_R12) {       // new, restarted or spawned
+        void *stack = taskStarted[to] ? taskCtx[to].uc_stack.ss_sp
+                                      : mmap(0, SIM_STACK, PROT_READ | PROT_WRITE,
+                                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+
+        taskStarted[to] = true;
+        getcontext(&taskCtx[to]);
+        taskCtx[to].uc_stack.ss_sp = stack;
+        taskCtx[to].uc_stack.ss_size = SIM_STACK;
+        taskCtx[to].uc_link = 0;
+        sigdelset(&taskCtx[to].uc_sigmask, SIGALRM);        // first run may be from the tick handler
+        makecontext(&taskCtx[to], simTaskEntry, 0);
+    }
+    simSwitchCount++;
+    simRunning = to;
+    swapcontext(from, &taskCtx[to]);
+}
+
+//-----------------------------------------------------------------------------
+// Exceptions
+//-----------------------------------------------------------------------------
+
+// SysTick counts down from RELOAD once raised, CURRENT tells the ISR how late it runs
+static void simLate(uint32_t due)
+{
+    uint32_t late = *simCycles() - due;
+
+    simStCurrent = late > simStReload ? 0 : simStReload - late;
+}
+
+// PendSV and deferred SysTicks, tail chained before the exception returns
+static void simTailChain(void)
+{
+    struct itimerval off = {{0, 0}, {0, 0}};
+
+    while(simTickPending || (simIntCtrl & NVIC_INT_CTRL_PEND_SV)) {
+        if(simTickPending) {
+            simTickPending--;
+            simLate(simTickDue);
+            simIpsr = IPSR_SYSTICK;
+            systickIsr();
+            simUartIsr();
+        }
+        if(simIntCtrl & NVIC_INT_CTRL_PEND_SV) {
+            simIntCtrl &= ~NVIC_INT_CTRL_PEND_SV;
+            simIpsr = IPSR_PENDSV;
+            pendSvIsr();
+        }
+    }
+    if(simApint & NVIC_APINT_SYSRESETREQ) {
+        setitimer(ITIMER_REAL, &off, 0);
+        printf("sim: reset requested\n");
+        exit(0);
+    }
+}
+
+// Called by simSvcEntry with the SVC text and the caller's R0-R3
+void simSvc(const char *text, uint64_t r0, uint64_t r1, uint64_t r2, uint64_t r3)
+{
+    const char *p = strchr(text, '#');
+    uint8_t n = p ? atoi(p + 1) : 0;
+    uint8_t task = simRunning == SIM_MAIN ? 0 : simRunning;
+    uint32_t *frame;
+
+    simInKernel = 1;
+    simSvcCount++;
+
+    frame = simPsp - 8;                     // hardware stacking
+    frame[0] = r0;
+    frame[1] = r1;
+    frame[2] = r2;
+    frame[3] = r3;
+    frame[4] = 0;
+    frame[5] = 0;
+    frame[6] = SIM_SVC_TABLE + 2*n + 2;     // PC after the SVC instruction
+    frame[7] = 0x01000000;
+    simPsp = frame;
+
+    simIpsr = IPSR_SVCALL;
+    svCallIsr();
+    simTailChain();
+
+    simR0[task] = frame[0];                 // this task's frame, whoever ran in between
+    simPsp = frame + 8;                     // exception return
+    simIpsr = 0;
+    simInKernel = 0;
+}
+
+// SysTick, entry latency is how late the host delivered the signal
+static void simTick(int sig)
+{
+    uint32_t now = *simCycles(), due;
+    uint32_t *frame;
+
+    due = now - simNextTick > simStReload ? now : simNextTick;    // far behind, start over
+    simNextTick = due + simStReload + 1;
+
+    if(!(simStCtrl & NVIC_ST_CTRL_ENABLE) || simRunning == SIM_MAIN)
+        return;
+    if(simInKernel) {
+        if(!simTickPending++)
+            simTickDue = due;
+        return;
+    }
+
+    simInKernel = 1;
+    frame = simPsp - 8;
+    frame[4] = 0;                           // R12, see SIM_FIRST_R12
+    simPsp = frame;
+    simLate(due);
+
+    simIpsr = IPSR_SYSTICK;
+    systickIsr();
+    simUartIsr();
+    simTailChain();
+
+    simPsp = frame + 8;
+    simIpsr = 0;
+    simInKernel = 0;
+}
+
+// Saves what the SVC wrapper still has in registers and calls simSvc on an aligned stack
+__asm__(
+    "    .text\n"
+    "    .globl simSvcEntry\n"
+    "simSvcEntry:\n"
+    "    push %rbp\n"
+    "    mov  %rsp, %rbp\n"
+    "    push %rax\n"
+    "    push %rcx\n"
+    "    push %rdx\n"
+    "    push %rsi\n"
+    "    push %rdi\n"
+    "    push %r8\n"
+    "    push %r9\n"
+    "    push %r10\n"
+    "    and  $-16, %rsp\n"
+    "    mov  %rcx, %r8\n"                  // R3
+    "    mov  %rdx, %rcx\n"                 // R2
+    "    mov  %rsi, %rdx\n"                 // R1
+    "    mov  %rdi, %rsi\n"                 // R0
+    "    mov  %r11, %rdi\n"                 // SVC text
+    "    call simSvc\n"
+    "    lea  -64(%rbp), %rsp\n"
+    "    pop  %r10\n"
+    "    pop  %r9\n"
+    "    pop  %r8\n"
+    "    pop  %rdi\n"
+    "    pop  %rsi\n"
+    "    pop  %rdx\n"
+    "    pop  %rcx\n"
+    "    pop  %rax\n"
+    "    pop  %rbp\n"
+    "    ret\n"
+);
+
+//-----------------------------------------------------------------------------
+// MPU
+//-----------------------------------------------------------------------------
+
+// One address as the MPU would see it: the highest enabled region that contains it and
+// does not disable its subregion decides, no region means the privileged background map
+static bool simMpuByte(uint32_t add, bool privileged)
+{
+    uint32_t attr, size, base;
+    int8_t r;
+
+    for(r=7; r>=0; r--) {
+        attr = simMpuAttr[r];
+        if(!(attr & NVIC_MPU_ATTR_ENABLE))
+            continue;
+        size = 1UL << (((attr >> 1) & 0x1F) + 1);
+        base = simMpuBase[r] & NVIC_MPU_BASE_ADDR_M & ~(size - 1);
+        if(add < base || add - base >= size)
+            continue;
+        if(size >= 256 && (attr >> 8) & (1 << ((add - base) / (size / 8))))
+            continue;                                           // subregion disabled
+        switch((attr >> 24) & 7) {
+            case 1: case 5:
+                return privileged;
+            case 0:
+                return false;
+            default:
+                return true;
+        }
+    }
+    return privileged;
+}
+
+// Would the running task (unprivileged) be allowed to touch add..add+size-1
+bool simMpuAllows(const void *add, uint32_t size)
+{
+    uint32_t a = (uint32_t)(uintptr_t)add;
+    uint32_t end = a + size;
+
+    for(; a < end; a = (a | 0x1FF) + 1)                         // once per 512 byte subregion
+        if(!simMpuByte(a, false))
+            return false;
+    return size == 0 || simMpuByte(end - 1, false);
+}
+
+//-----------------------------------------------------------------------------
+// Start up
+//-----------------------------------------------------------------------------
+
+void simInit(void)
+{
+    uint8_t *sram;
+    struct sigaction sa;
+    struct itimerval tick = {{0, 1000}, {0, 1000}};
+    uint16_t n;
+
+    sram = mmap((void *)SIM_SRAM_BASE, SIM_SRAM_SIZE, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if(sram != (uint8_t *)SIM_SRAM_BASE) {
+        perror("sim: SRAM at 0x20000000");
+        exit(2);
+    }
+    for(n=0; n<256; n++) {                                      // the kernel area is not used
+        sram[2*n] = n;                                          // on the host, kernel data are
+        sram[2*n + 1] = 0xDF;                                   // host globals
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = simTick;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGALRM, &sa, 0);
+    simStReload = 39999;
+    simNextTick = *simCycles() + simStReload + 1;
+    setitimer(ITIMER_REAL, &tick, 0);
+}
+
+//-----------------------------------------------------------------------------
+// UART and log, what kernel.c calls in them
+//-----------------------------------------------------------------------------
+
+// UART0 TX for the uart scenarios: a 16 byte FIFO that sends a byte every SIM_UART_BYTE
+// cycles of host time, fed from the TX ring by simUartIsr after each SysTick (the target's
+// TX interrupt comes with 2 bytes left, the FIFO holds 1.4 ms). Bytes are counted, not printed
+#define SIM_UART_BYTE   3472                // 10 bits at 115200 baud, 40 MHz cycles
+#define SIM_UART_FIFO   16
+#define SIM_UART_RING   128                 // TX_BUFFER_SIZE
+
+static uint32_t simUartMark;                // cycles the FIFO was last brought up to
+static uint16_t simUartFifo, simUartRing;   // bytes held
+static bool simUartWaiting;
+uint64_t simUartSent = 0;
+
+// Take out of the FIFO what the line has sent since simUartMark
+static void simUartDrain(void)
+{
+    uint32_t now = *simCycles();
+    uint32_t sent = (now - simUartMark) / SIM_UART_BYTE;
+
+    if(sent >= simUartFifo) {
+        simUartSent += simUartFifo;
+        simUartFifo = 0;
+        simUartMark = now;
+    }
+    else {
+        simUartSent += sent;
+        simUartFifo -= sent;
+        simUartMark += sent * SIM_UART_BYTE;
+    }
+}
+
+// uart0TxKick
+static void simUartKick(void)
+{
+    simUartDrain();
+    while(simUartRing && simUartFifo < SIM_UART_FIFO) {
+        simUartRing--;
+        simUartFifo++;
+    }
+}
+
+// TX half of uart0Isr. Leaves the FIFO alone while the ring is unused, simUartPutc owns it then
+static void simUartIsr(void)
+{
+    if(!simUartRing && !simUartWaiting)
+        return;
+    simIpsr = IPSR_UART0;
+    simUartKick();
+    if(simUartWaiting && simUartRing < SIM_UART_RING) {
+        simUartWaiting = false;
+        taskPostAll(uartTxFree);
+    }
+}
+
+// putcUart0 before the TX ring: spins in the task while the FIFO is full
+void simUartPutc(char c)
+{
+    do
+        simUartDrain();
+    while(simUartFifo == SIM_UART_FIFO);
+    simUartFifo++;
+}
+
+void putsUart0(char *str)                                   { fputs(str, stdout); }
+
+uint16_t writeTxBuffer(const char *str, uint32_t max)
+{
+    uint16_t n = 0;
+
+    while(n < max && str[n] != 0 && simUartRing < SIM_UART_RING) {
+        simUartRing++;
+        n++;
+    }
+    if(n < max && str[n] != 0) {
+        simUartWaiting = true;
+        taskBlock(uartTxFree);
+    }
+    simUartKick();
+    return n;
+}
+
+int16_t readRxBuffer(void)                                  { taskBlock(uartRxReady); return -1; }
+bool rxBufferEmpty(void)                                    { return true; }
+uint8_t readRxBytes(char *buf, uint8_t max)                 { taskBlock(uartRxReady); return 0; }
+bool writeDmaBlock(const void *src, uint16_t len)           { fwrite(src, 1, len, stdout); return true; }
+bool uart0DmaBusy(void)                                     { return false; }
+
+bool strgcmp(char *str1, const char str2[])
+{
+    uint32_t i = 0;
+
+    while(str1[i] != 0) {
+        if(str1[i] != str2[i])
+            return 0;
+        i++;
+    }
+    return 1;
+}
+
+void strgcopy(char *dest, const char source[])
+{
+    while((*dest++ = *source++));
+}
+
+void logKernel(uint8_t id, uint8_t nargs, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3) { }
+bool logRingAccessible(uint64_t srd, LOG_RING *ring)        { return false; }
+void logRegister(uint8_t task, LOG_RING *ring)              { }
+void logRelease(uint8_t task)                               { }
+LOG_RING *logRingOf(uint8_t task)                           { return 0; }
+void logFlushRecords(void)                                  { }
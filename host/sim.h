@@ -0,0 +1,18 @@
+// Host simulation of the TM4C123 core for the RTOS kernel
+// J Losh
+
+#ifndef SIM_H_
+#define SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+extern uint64_t simSvcCount;                // SVCs taken
+extern uint64_t simSwitchCount;             // host context switches (task changes)
+extern uint64_t simUartSent;                // bytes the modeled UART0 TX line has sent
+
+void simInit(void);
+bool simMpuAllows(const void *add, uint32_t size);
+void simUartPutc(char c);
+
+#endif
@@ -0,0 +1,538 @@
+// Host benchmarks and allocator fuzzing on the simulated kernel
+// J Losh
+
+// Use: ./simbench fuzz [ops] [seed]       allocator only, no tasks: random mallocFromHeap
+//                                          and frees, checks the heap invariants after each
+//      ./simbench SCENARIO [seconds]      starts the RTOS with the scenario's tasks, then
+//                                          prints op rates, per-task stats and latency max
+//      scenarios: yield, pingpong, mutex, malloc, mixed (everything at one priority),
+//                 budget (a runaway task over its budget is demoted below a worker),
+//                 spawn (a detached worker per request, spawned at runtime),
+//                 uart / uartpoll (a shell writes ps sized bursts to UART0 through the TX
+//                 ring / by spinning on the FIFO as putcUart0 did before it, a background
+//                 task takes the CPU left; compare the Shell CPU%)
+//      ./simbench heap [trace...]          replays the built in allocator traces (the same
+//                                          as the BENCH firmware) or trace files, one op per
+//                                          line as in Project/heapbench.h, # comments, and
+//                                          prints the {"bench":"heap"} line for benchcmp
+// Build: see sim.c
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "kernel.h"
+#include "mm.h"
+#include "stats.h"
+#include "prof.h"
+#include "heapbench.h"
+#include "shell.h"
+#include "sim.h"
+
+#define PING            keyPressed
+#define PONG            keyReleased
+#define HEAP_BYTES      256
+#define FUZZ_LIVE       24                  // pointers the fuzzer keeps track of
+#define TRACE_MAX_OPS   65535               // per trace file, HEAP_TRACE counts in 16 bits
+#define TRACE_MAX_FILES 8
+#define BURST_LINES     14                  // ps with a dozen tasks
+#define BURST_WIDTH     80
+
+
+static const char *scenario;
+static uint32_t seconds = 2;
+static volatile uint64_t ops[MAX_TASKS];
+static uint64_t mpuFaults = 0;
+static const char *opsName[MAX_TASKS];
+static uint8_t opsCount = 0;
+
+//-----------------------------------------------------------------------------
+// Tasks
+//-----------------------------------------------------------------------------
+
+static uint8_t opsSlot(const char *name)
+{
+    opsName[opsCount] = name;
+    return opsCount++;
+}
+
+void simIdle(void)
+{
+    while(true)
+        yield();
+}
+
+void yielder(void)
+{
+    uint8_t k = opsSlot("yield");
+
+    while(true) {
+        yield();
+        ops[k]++;
+    }
+}
+
+void pinger(void)
+{
+    uint8_t k = opsSlot("ping-pong round trips");
+
+    while(true) {
+        post(PING);
+        wait(PONG);
+        ops[k]++;
+    }
+}
+
+void ponger(void)
+{
+    while(true) {
+        wait(PING);
+        post(PONG);
+    }
+}
+
+// Two lockers take turns, each lock after the first finds the mutex free
+void lockCycle(const char *name)
+{
+    uint8_t k = opsSlot(name);
+
+    while(true) {
+        lock(resource);
+        ops[k]++;
+        unlock(resource);
+        yield();                                    // let the other locker in
+    }
+}
+
+void locker1(void)
+{
+    lockCycle("lock/unlock 1");
+}
+
+void locker2(void)
+{
+    lockCycle("lock/unlock 2");
+}
+
+// Handle malloc/free through the SVCs, checking the block is open to this task only
+void allocator(void)
+{
+    uint8_t k = opsSlot("malloc/free");
+    uint8_t h;
+    uint32_t *p;
+
+    while(true) {
+        h = _mallocHandle(HEAP_BYTES);
+        if(h != NO_HANDLE) {
+            p = _lockHandle(h);
+            if(!p || !simMpuAllows(p, HEAP_BYTES))
+                mpuFaults++;
+            else
+                p[0] = 0x5A5A5A5A;
+            _unlockHandle(h);
+            _freeHandle(h);
+        }
+        ops[k]++;
+    }
+}
+
+// Never blocks, so its release never ends: with a budget it only holds its priority for that long
+void runaway(void)
+{
+    uint8_t k = opsSlot("runaway loops");
+
+    while(true)
+        ops[k]++;
+}
+
+// 1 ms period, well inside its budget
+void sleeper(void)
+{
+    uint8_t k = opsSlot("sleeper releases");
+
+    while(true) {
+        sleep(1);
+        ops[k]++;
+    }
+}
+
+// A worker per request, detached: returning ends it and frees its tcb record
+#define REQUEST_ARG     0x20001234
+static uint8_t requestSlot, badArgSlot;
+
+void requestWorker(void *arg)
+{
+    if((uintptr_t)arg != REQUEST_ARG)
+        ops[badArgSlot]++;
+    ops[requestSlot]++;
+}
+
+// Spawns a worker per request at its own priority, yields to them while no record is free.
+// The attributes must be in task memory, host statics are not in the target's flash
+void dispatcher(void)
+{
+    uint8_t k = opsSlot("spawns");
+    THREAD_ATTR *attr = _mallocFromHeap(sizeof(THREAD_ATTR));
+
+    requestSlot = opsSlot("requests handled");
+    badArgSlot = opsSlot("bad worker args");
+    if(!attr) {
+        fprintf(stderr, "dispatcher: no memory for the attributes\n");
+        exit(2);
+    }
+    memset(attr, 0, sizeof(THREAD_ATTR));
+    strcpy(attr->name, "Request");
+    attr->stackBytes = 512;
+    attr->priority = 10;
+    attr->detached = true;
+
+    while(true) {
+        if(spawnThread((_fn)requestWorker, (void *)REQUEST_ARG, attr))
+            ops[k]++;
+        else
+            yield();
+    }
+}
+
+// A ps burst in task memory: UART_WRITE only reads flash or the caller's SRAM, and host
+// statics are neither
+static char *burstText(void)
+{
+    char *text = _mallocFromHeap(BURST_LINES * BURST_WIDTH + 1);
+    uint16_t i;
+
+    if(!text) {
+        fprintf(stderr, "shell: no memory for the burst\n");
+        exit(2);
+    }
+    for(i=0; i<BURST_LINES * BURST_WIDTH; i++)
+        text[i] = (i % BURST_WIDTH == BURST_WIDTH - 1) ? '\n' : 'a' + i % 26;
+    text[i] = 0;
+    return text;
+}
+
+// putsUart0 through the TX ring, the SVC sleeps on uartTxFree while the ring is full
+void shellRing(void)
+{
+    uint8_t k = opsSlot("ps bursts");
+    char *text = burstText();
+    uint16_t i;
+
+    while(true) {
+        for(i=0; text[i]; )
+            i += _writeUart0(&text[i]);
+        ops[k]++;
+    }
+}
+
+// putsUart0 before the ring, putcUart0 spinning on TXFF
+void shellPoll(void)
+{
+    uint8_t k = opsSlot("ps bursts");
+    char *text = burstText();
+    uint16_t i;
+
+    while(true) {
+        for(i=0; text[i]; i++)
+            simUartPutc(text[i]);
+        ops[k]++;
+    }
+}
+
+void background(void)
+{
+    uint8_t k = opsSlot("background loops");
+
+    while(true)
+        ops[k]++;
+}
+
+void reporter(void)
+{
+    static SNAPSHOT snap;
+    LAT_HIST lat[LAT_COUNT];
+    static const char *latNames[LAT_COUNT] = {
+        "systick", "wtimer1", "svc", "pendsv", "sleep", "isr post", "task post"
+    };
+    uint8_t i;
+
+    sleep(seconds * 1000);
+
+    printf("%s, %u s\n", scenario, seconds);
+    for(i=0; i<opsCount; i++)
+        printf("  %-24s %12.0f /s\n", opsName[i], (double)ops[i] / seconds);
+    printf("  %-24s %12.0f /s\n", "svc", (double)simSvcCount / seconds);
+    printf("  %-24s %12.0f /s\n", "context switches", (double)simSwitchCount / seconds);
+    if(simUartSent)
+        printf("  %-24s %12.0f /s\n", "UART0 bytes sent", (double)simUartSent / seconds);
+    if(mpuFaults)
+        printf("  MPU would have faulted %llu times\n", (unsigned long long)mpuFaults);
+
+    fillSnapshot(&snap);
+    printf("  task   name        CPU%% over the last %u ms\n", CPU_SAMPLE_MS * CPU_WINDOW_SLOTS);
+    for(i=0; i<snap.taskCount; i++)
+        if(snap.task[i].state != STATE_INVALID)
+            printf("  %-6u %-11s %u.%02u\n", i, snap.task[i].name, snap.task[i].cpu / 100, snap.task[i].cpu % 100);
+
+    if(kstats) {
+        printf("  task   vol         invol       ready ms  max response cycles\n");
+        for(i=0; i<MAX_TASKS; i++)
+            if(kstats->task[i].voluntary || kstats->task[i].involuntary)
+                printf("  %-6u %-11u %-11u %-9u %u\n", i, kstats->task[i].voluntary,
+                       kstats->task[i].involuntary, kstats->task[i].readyMs,
+                       kstats->task[i].maxResponse);
+        printf("  task   releases    exec min    exec mean   exec max    overruns\n");
+        for(i=0; i<MAX_TASKS; i++)
+            if(kstats->task[i].releases || kstats->task[i].overruns)
+                printf("  %-6u %-11u %-11u %-11u %-11u %u\n", i, kstats->task[i].releases,
+                       kstats->task[i].execMin,
+                       kstats->task[i].releases ? kstats->task[i].execSum / kstats->task[i].releases : 0,
+                       kstats->task[i].execMax, kstats->task[i].overruns);
+        latCopy(lat, false);
+        printf("  latency max cycles:");
+        for(i=0; i<LAT_COUNT; i++)
+            printf(" %s %u", latNames[i], lat[i].worst);
+        printf("\n");
+    }
+    exit(mpuFaults ? 1 : 0);
+}
+
+//-----------------------------------------------------------------------------
+// Allocator fuzzing
+//-----------------------------------------------------------------------------
+
+// Blocks inside the heap, no overlaps, and subRegInUse set exactly under live blocks
+static bool heapConsistent(void)
+{
+    uint64_t covered = 0, bits;
+    uint8_t i, j, start, count;
+    uint32_t a, b;
+
+    for(i=0; i<numAllocs; i++) {
+        a = (uint32_t)(uintptr_t)HCB_table[i].ptr;
+        if(a < BASE_ADD || a + HCB_table[i].size > R4_8k + 0x2000)
+            return false;
+        for(j=i+1; j<numAllocs; j++) {
+            b = (uint32_t)(uintptr_t)HCB_table[j].ptr;
+            if(a < b + HCB_table[j].size && b < a + HCB_table[i].size)
+                return false;
+        }
+        start = find_SR(HCB_table[i].ptr);
+        count = countSubregs(start, HCB_table[i].size);
+        bits = (count == 64 ? ~0ULL : (1ULL << count) - 1) << start;
+        if(covered & bits)
+            return false;
+        covered |= bits;
+    }
+    return covered == subRegInUse;
+}
+
+static int fuzz(uint32_t count, uint32_t seed)
+{
+    void *live[FUZZ_LIVE] = {0};
+    uint32_t want[FUZZ_LIVE];
+    uint32_t n, allocs = 0, fails = 0, size;
+    uint8_t slot;
+    int8_t idx;
+    struct timespec t0, t1;
+    double s;
+
+    srand(seed);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(n=0; n<count; n++) {
+        slot = rand() % FUZZ_LIVE;
+        if(live[slot]) {                                        // free it, as freeHandle does
+            idx = findHCB(live[slot]);
+            if(idx < 0) {
+                printf("fuzz: op %u, live block %p lost\n", n, live[slot]);
+                return 1;
+            }
+            freeTask(idx);
+            numAllocs--;
+            live[slot] = 0;
+        }
+        else {
+            size = rand() % 8 ? 1 + rand() % 1024 : 1 + rand() % 8192;
+            live[slot] = mallocFromHeap(size);
+            want[slot] = size;
+            allocs++;
+            if(!live[slot])
+                fails++;
+            else if(allocSize(live[slot]) < want[slot]) {
+                printf("fuzz: op %u, %u bytes asked, %u given\n", n, size, allocSize(live[slot]));
+                return 1;
+            }
+        }
+        if(!heapConsistent()) {
+            printf("fuzz: op %u, heap inconsistent (seed %u)\n", n, seed);
+            return 1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    s = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("fuzz: %u ops, %u mallocs (%u refused), seed %u, heap consistent, %.0f ops/s\n",
+           count, allocs, fails, seed, count / s);
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Allocator trace replay
+//-----------------------------------------------------------------------------
+
+// Reads a trace file, returns the number of ops or -1
+static int loadTrace(const char *file, HEAP_OP *ops)
+{
+    char line[128], type;
+    unsigned a, b, c;
+    int n = 0, lineNo = 0, fields;
+    FILE *in;
+
+    if(!(in = fopen(file, "r"))) {
+        perror(file);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), in) && n < TRACE_MAX_OPS) {
+        lineNo++;
+        a = b = c = 0;
+        fields = sscanf(line, " %c %u %u %u", &type, &a, &b, &c);
+        if(fields < 1 || type == '#')
+            continue;
+        ops[n].type = type;
+        ops[n].slot = a;
+        ops[n].owner = b;
+        ops[n].size = c;
+        if(type == HEAP_KILL) {
+            ops[n].slot = 0;
+            ops[n].owner = a;
+        }
+        if(!((type == HEAP_ALLOC || type == HEAP_STACK) && fields == 4)
+           && !((type == HEAP_FREE || type == HEAP_KILL) && fields >= 2)) {
+            fprintf(stderr, "%s:%d: bad op\n", file, lineNo);
+            fclose(in);
+            return -1;
+        }
+        n++;
+    }
+    fclose(in);
+    return n;
+}
+
+static int heap(int files, char *file[])
+{
+    static HEAP_OP ops[TRACE_MAX_FILES][TRACE_MAX_OPS];
+    HEAP_RESULT r[TRACE_MAX_FILES];
+    HEAP_TRACE trace;
+    uint8_t before = numAllocs;
+    int i, n;
+
+    if(!files)
+        heapBench();
+    else {
+        if(files > TRACE_MAX_FILES)
+            files = TRACE_MAX_FILES;
+        for(i=0; i<files; i++) {
+            if((n = loadTrace(file[i], ops[i])) < 0)
+                return 2;
+            trace.name = strrchr(file[i], '/') ? strrchr(file[i], '/') + 1 : file[i];
+            trace.ops = ops[i];
+            trace.count = n;
+            trace.seed = 0;
+            trace.restartPct = 0;
+            heapReplay(&trace, &r[i]);
+        }
+        putHeapResults(r, files);
+    }
+
+    if(!heapConsistent() || numAllocs != before) {
+        printf("heap: replay left the heap inconsistent\n");
+        return 1;
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
+
+int main(int argc, char *argv[])
+{
+    bool ok = true;
+
+    if(argc < 2) {
+        fprintf(stderr, "use: %s fuzz [ops] [seed] | heap [trace...] | yield|pingpong|mutex|malloc|mixed [seconds]\n",
+                argv[0]);
+        return 2;
+    }
+    scenario = argv[1];
+
+    simInit();
+    initRtos();
+    allowFlashAccess();
+    allowPeripheralAccess();
+    setupSramAccess();
+
+    if(!strcmp(scenario, "fuzz"))
+        return fuzz(argc > 2 ? atoi(argv[2]) : 1000000, argc > 3 ? atoi(argv[3]) : 1);
+    if(!strcmp(scenario, "heap"))
+        return heap(argc - 2, argv + 2);
+    if(argc > 2)
+        seconds = atoi(argv[2]);
+
+    initMutex(resource);
+    initSemaphore(PING, 0);
+    initSemaphore(PONG, 0);
+
+    ok &= createThread(simIdle, "Idle", 15, 512);
+    ok &= createThread(reporter, "Reporter", 0, 512);
+    if(!strcmp(scenario, "yield")) {
+        ok &= createThread(yielder, "Yield", 8, 512);
+    }
+    else if(!strcmp(scenario, "pingpong")) {
+        ok &= createThread(pinger, "Ping", 8, 512);
+        ok &= createThread(ponger, "Pong", 8, 512);
+    }
+    else if(!strcmp(scenario, "mutex")) {
+        ok &= createThread(locker1, "Lock1", 8, 512);
+        ok &= createThread(locker2, "Lock2", 8, 512);
+    }
+    else if(!strcmp(scenario, "malloc")) {
+        ok &= createThread(allocator, "Malloc", 8, 512);
+    }
+    else if(!strcmp(scenario, "mixed")) {
+        ok &= createThread(yielder, "Yield", 12, 512);
+        ok &= createThread(pinger, "Ping", 12, 512);
+        ok &= createThread(ponger, "Pong", 12, 512);
+        ok &= createThread(locker1, "Lock1", 12, 512);
+        ok &= createThread(allocator, "Malloc", 12, 512);
+    }
+    else if(!strcmp(scenario, "budget")) {
+        ok &= createThread(runaway, "Runaway", 8, 512) && setThreadBudget(runaway, 1000);
+        ok &= createThread(sleeper, "Sleeper", 8, 512) && setThreadBudget(sleeper, 100);
+        ok &= createThread(yielder, "Worker", 12, 512);
+    }
+    else if(!strcmp(scenario, "spawn")) {
+        ok &= createThread(dispatcher, "Dispatch", 10, 1024);
+    }
+    else if(!strcmp(scenario, "uart") || !strcmp(scenario, "uartpoll")) {
+        ok &= createThread(scenario[4] ? shellPoll : shellRing, "Shell", 12, 1024);
+        ok &= createThread(background, "Busy", 14, 512);
+    }
+    else {
+        fprintf(stderr, "unknown scenario %s\n", scenario);
+        return 2;
+    }
+
+    if(!ok) {
+        fprintf(stderr, "could not create the tasks\n");
+        return 2;
+    }
+    if(!initStats() || !initProf()) {
+        fprintf(stderr, "no heap left for the kernel statistics or profiler\n");
+        return 2;
+    }
+    startRtos();
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Host regression check for the RTOS benchmark
+// J Losh
+
+// Compares two result lines of the benchmark firmware (Project/bench.c, BENCH 1), a saved
+// baseline and a new run, and fails when any primitive's average got slower by more than
+// the allowed percentage, so a CI job can run it on the captured UART output.
+// Each file may hold other text, the last line starting with {"bench" is used, or the
+// last {"bench":"<kind>" line when a kind is given. The heap lines (Project/heapbench.c,
+// also printed by host/simbench heap) carry an allocation success rate too, a drop in
+// it of more than the percentage (in points) is a regression as well.
+//
+// Build: gcc -O2 -o benchcmp benchcmp.c
+// Use:   ./benchcmp baseline.json current.json [percent] [kind]      (10 % by default)
+//        kind is rtos or heap, exit status 0 = no regression, 1 = regression, 2 = bad input
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE        4096
+#define MAX_RESULTS     32
+
+typedef struct {
+    char name[32];
+    unsigned long min, avg, max;
+    long success;                                   // -1 if the line has none
+} RESULT;
+
+static int load(const char *file, RESULT *r, const char *kind)
+{
+    char line[MAX_LINE], last[MAX_LINE] = "", want[48];
+    FILE *in;
+    char *p, *s, *end;
+    int n = 0;
+
+    snprintf(want, sizeof(want), kind ? "{\"bench\":\"%s\"" : "{\"bench\"", kind);
+
+    if(!(in = fopen(file, "r"))) {
+        perror(file);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), in))
+        if(!strncmp(line, want, strlen(want)))
+            strcpy(last, line);
+    fclose(in);
+
+    for(p = strstr(last, "{\"name\":\""); p && n < MAX_RESULTS; p = strstr(p + 1, "{\"name\":\"")) {
+        if(sscanf(p, "{\"name\":\"%31[^\"]\",\"min\":%lu,\"avg\":%lu,\"max\":%lu",
+                  r[n].name, &r[n].min, &r[n].avg, &r[n].max) == 4) {
+            end = strchr(p, '}');
+            s = strstr(p, ",\"success\":");
+            r[n].success = s && (!end || s < end) ? atol(s + 11) : -1;
+            n++;
+        }
+    }
+    if(!n)
+        fprintf(stderr, "%s: no benchmark results\n", file);
+    return n ? n : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    RESULT base[MAX_RESULTS], cur[MAX_RESULTS];
+    int nb, nc, i, j, failed = 0;
+    double limit = 10, change;
+
+    if(argc < 3) {
+        fprintf(stderr, "use: %s baseline current [percent] [kind]\n", argv[0]);
+        return 2;
+    }
+    if(argc > 3)
+        limit = atof(argv[3]);
+    if((nb = load(argv[1], base, argc > 4 ? argv[4] : 0)) < 0
+       || (nc = load(argv[2], cur, argc > 4 ? argv[4] : 0)) < 0)
+        return 2;
+
+    printf("%-20s %10s %10s %8s\n", "primitive", "base avg", "avg", "change");
+    for(i=0; i<nc; i++) {
+        for(j=0; j<nb && strcmp(base[j].name, cur[i].name); j++);
+        if(j == nb) {
+            printf("%-20s %10s %10lu %8s\n", cur[i].name, "-", cur[i].avg, "new");
+            continue;
+        }
+        change = base[j].avg ? 100.0 * ((double)cur[i].avg - base[j].avg) / base[j].avg : 0;
+        printf("%-20s %10lu %10lu %+7.1f%%%s\n", cur[i].name, base[j].avg, cur[i].avg, change,
+               change > limit ? "  REGRESSION" : "");
+        if(change > limit)
+            failed = 1;
+        if(base[j].success >= 0 && cur[i].success >= 0) {
+            printf("%-20s %9ld%% %9ld%% %+7ld%s\n", "  success", base[j].success, cur[i].success,
+                   cur[i].success - base[j].success,
+                   base[j].success - cur[i].success > limit ? "  REGRESSION" : "");
+            if(base[j].success - cur[i].success > limit)
+                failed = 1;
+        }
+    }
+    return failed;
+}
@@ -0,0 +1,144 @@
+// Host decoder for the RTOS binary log
+// J Losh
+
+// Reads the UART byte stream (a capture file or the serial device, already set to the
+// right baud rate, e.g. stty -F /dev/ttyACM0 921600 raw) and prints one line per log
+// record. Frames are COBS encoded and 0x00 delimited; anything between delimiters that is
+// not a valid frame (shell text sharing the UART) is passed through as is.
+//
+// Build: gcc -O2 -o logdecode logdecode.c
+// Use:   ./logdecode [file] [cpu Hz]      (stdin and 40 MHz by default)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_FMT(id, fmt) fmt,
+static const char *formats[] = {
+#include "../Project/logfmt.h"
+};
+#undef LOG_FMT
+
+#define FORMAT_COUNT    (int)(sizeof(formats)/sizeof(formats[0]))
+#define MAX_ARGS        4
+#define MAX_FRAME       256
+#define KERNEL_TASK     0xFF
+
+// Undo COBS, returns decoded length or -1 if the frame is malformed
+static int cobsDecode(const uint8_t *src, int len, uint8_t *dst)
+{
+    int in = 0, out = 0, i;
+    uint8_t code;
+
+    while(in < len) {
+        code = src[in++];
+        if(code == 0 || in + code - 1 > len)
+            return -1;
+        for(i=1; i<code; i++)
+            dst[out++] = src[in++];
+        if(code != 0xFF && in < len)
+            dst[out++] = 0;
+    }
+    return out;
+}
+
+static uint32_t word(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Timestamps are a 32-bit cycle counter, unwrap them into a 64-bit time line
+static uint64_t unwrap(uint32_t t)
+{
+    static uint64_t last = 0;
+    static int first = 1;
+    uint64_t now = (last & ~0xFFFFFFFFULL) | t;
+
+    if(first) {
+        first = 0;
+        last = now;
+        return now;
+    }
+    if(now + 0x80000000ULL < last)                  // wrapped, records arrive roughly in order
+        now += 0x100000000ULL;
+    if(now > last)
+        last = now;
+    return now;
+}
+
+// Returns 1 if the frame was a log record and has been printed
+static int printRecord(const uint8_t *frame, int len, double hz)
+{
+    uint8_t rec[MAX_FRAME];
+    uint32_t header, args[MAX_ARGS] = {0};
+    uint8_t sum = 0;
+    int n, i, nargs, id, task;
+    uint64_t t;
+
+    n = cobsDecode(frame, len, rec);
+    if(n < 9 || (n - 1) % 4)
+        return 0;
+    for(i=0; i<n; i++)
+        sum += rec[i];
+    if(sum)
+        return 0;
+
+    header = word(rec);
+    id = header >> 24;
+    nargs = (header >> 16) & 0xF;
+    task = header & 0xFF;
+    if(nargs > MAX_ARGS || n != (2 + nargs)*4 + 1)
+        return 0;
+
+    t = unwrap(word(rec + 4));
+    for(i=0; i<nargs; i++)
+        args[i] = word(rec + 8 + 4*i);
+
+    printf("%12.6f ", t / hz);
+    if(task == KERNEL_TASK)
+        printf("kernel  ");
+    else
+        printf("task %-3d", task);
+    if(id < FORMAT_COUNT)
+        printf(formats[id], args[0], args[1], args[2], args[3]);
+    else
+        printf("unknown id %d (%d args)", id, nargs);
+    printf("\n");
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    double hz = 40e6;
+    uint8_t frame[MAX_FRAME];
+    int c, len = 0;
+
+    if(argc > 1 && strcmp(argv[1], "-") && !(in = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    if(argc > 2)
+        hz = atof(argv[2]);
+
+    while((c = fgetc(in)) != EOF) {
+        if(c != 0) {
+            if(len < MAX_FRAME)
+                frame[len++] = c;
+            else {                                  // too long for a record, must be text
+                fwrite(frame, 1, len, stdout);
+                len = 0;
+                frame[len++] = c;
+            }
+            continue;
+        }
+        if(len && !printRecord(frame, len, hz))
+            fwrite(frame, 1, len, stdout);
+        len = 0;
+        fflush(stdout);
+    }
+    if(len)
+        fwrite(frame, 1, len, stdout);
+    return 0;
+}
@@ -0,0 +1,227 @@
+// Host symbolizer for the RTOS sampling profiler
+// J Losh
+
+// Reads the output of the shell's "prof DUMP" (a capture file, shell text around it is
+// skipped, see Project/prof.h) and the ELF the firmware was built from, and prints a flat
+// profile: samples per function, most first. With -a it also lists every sampled PC as
+// function+offset, addr2line -e on the same ELF turns those into source lines.
+//
+// Functions are the ELF32 symbol table's FUNC symbols. The TI compiler also marks its
+// local labels ($C$...) as FUNC, those are skipped. Assembly routines have size 0 and are
+// taken to run up to the next function.
+//
+// Build: gcc -O2 -o profsym profsym.c
+// Use:   ./profsym [-a] <elf> [dump file]     (stdin by default), e.g.
+//        ./profsym ../Project/Debug/Project.out capture.txt
+//        exit status 0 = ok, 1 = no P line or an unreadable ELF, 2 = bad use
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_LINE        256
+#define MAX_PCS         1024
+#define EM_ARM          40
+#define SHT_SYMTAB      2
+#define STT_FUNC        2
+
+typedef struct {
+    uint32_t start, end;                    // end 0 until sized
+    const char *name;
+    uint32_t count;
+} FUNC;
+
+typedef struct {
+    uint32_t pc, count;
+    FUNC *fn;
+} PC;
+
+static FUNC *funcs;
+static int funcCount;
+static PC pcs[MAX_PCS];
+static int pcCount;
+
+static uint32_t get16(const uint8_t *p)
+{
+    return p[0] | p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int byStart(const void *a, const void *b)
+{
+    const FUNC *x = a, *y = b;
+
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static int byCount(const void *a, const void *b)
+{
+    const FUNC *x = a, *y = b;
+
+    return x->count > y->count ? -1 : x->count < y->count;
+}
+
+static int byPcCount(const void *a, const void *b)
+{
+    const PC *x = a, *y = b;
+
+    return x->count > y->count ? -1 : x->count < y->count;
+}
+
+// FUNC symbols of a little endian ELF32 ARM file, sorted by address. 0 if it is not one
+static int loadElf(const char *file)
+{
+    FILE *f = fopen(file, "rb");
+    uint8_t *elf, *sh, *sym;
+    const char *strtab;
+    long size;
+    uint32_t shoff, shentsize, shnum, i, j, value, fsize, type;
+
+    if(!f)
+        return 0;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    elf = malloc(size);
+    if(!elf || fread(elf, 1, size, f) != (size_t)size) {
+        fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    if(size < 52 || memcmp(elf, "\177ELF", 4) || elf[4] != 1 || elf[5] != 1 || get16(elf + 18) != EM_ARM)
+        return 0;
+    shoff = get32(elf + 32);
+    shentsize = get16(elf + 46);
+    shnum = get16(elf + 48);
+    if(shoff + shnum * shentsize > (uint32_t)size)
+        return 0;
+
+    for(i=0; i<shnum; i++) {
+        sh = elf + shoff + i * shentsize;
+        if(get32(sh + 4) != SHT_SYMTAB)
+            continue;
+        sym = elf + get32(sh + 16);
+        strtab = (const char *)elf + get32(elf + shoff + get32(sh + 24) * shentsize + 16);
+        funcs = calloc(get32(sh + 20) / 16, sizeof(FUNC));
+        for(j=0; j<get32(sh + 20) / 16; j++, sym += 16) {
+            type = sym[12] & 0xF;
+            value = get32(sym + 4) & ~1u;           // Thumb bit
+            fsize = get32(sym + 8);
+            if(type != STT_FUNC || strtab[get32(sym)] == '$' || strtab[get32(sym)] == '.')
+                continue;
+            funcs[funcCount].start = value;
+            funcs[funcCount].end = fsize ? value + fsize : 0;
+            funcs[funcCount].name = strtab + get32(sym);
+            funcCount++;
+        }
+        break;
+    }
+    if(!funcCount)
+        return 0;
+
+    qsort(funcs, funcCount, sizeof(FUNC), byStart);
+    for(i=0; i<(uint32_t)funcCount; i++)
+        if(!funcs[i].end)
+            funcs[i].end = i + 1 < (uint32_t)funcCount ? funcs[i+1].start : funcs[i].start + 4;
+    return 1;
+}
+
+// The function pc is in, 0 if none
+static FUNC *findFunc(uint32_t pc)
+{
+    int lo = 0, hi = funcCount - 1, mid, best = -1;
+
+    while(lo <= hi) {
+        mid = (lo + hi) / 2;
+        if(funcs[mid].start <= pc) {
+            best = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+    for(; best >= 0 && funcs[best].start <= pc; best--)     // aliases share a start
+        if(pc < funcs[best].end)
+            return &funcs[best];
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    char line[MAX_LINE];
+    unsigned long samples = 0, missed = 0, hz = 0, pc, count, unknown = 0;
+    int i = 1, all = 0, header = 0;
+
+    if(i < argc && !strcmp(argv[i], "-a")) {
+        all = 1;
+        i++;
+    }
+    if(i >= argc || argc - i > 2) {
+        fprintf(stderr, "use: %s [-a] <elf> [dump file]\n", argv[0]);
+        return 2;
+    }
+    if(!loadElf(argv[i])) {
+        fprintf(stderr, "%s: not an ARM ELF32 file with a symbol table\n", argv[i]);
+        return 1;
+    }
+    if(i + 1 < argc && !(in = fopen(argv[i+1], "r"))) {
+        perror(argv[i+1]);
+        return 1;
+    }
+
+    while(fgets(line, sizeof(line), in)) {
+        if(sscanf(line, "P,%lu,%lu,%lu", &samples, &missed, &hz) == 3) {
+            header = 1;
+            pcCount = 0;                                // a later dump replaces an earlier one
+        }
+        else if(header && sscanf(line, "C,%lx,%lu", &pc, &count) == 2 && pcCount < MAX_PCS) {
+            pcs[pcCount].pc = pc;
+            pcs[pcCount].count = count;
+            pcCount++;
+        }
+    }
+    if(!header) {
+        fprintf(stderr, "no prof DUMP output (P line) found\n");
+        return 1;
+    }
+
+    for(i=0; i<pcCount; i++) {
+        pcs[i].fn = findFunc(pcs[i].pc);
+        if(pcs[i].fn)
+            pcs[i].fn->count += pcs[i].count;
+        else
+            unknown += pcs[i].count;
+    }
+
+    printf("%lu samples at %lu Hz (%.2f s), %lu missed\n", samples, hz, hz ? (double)samples / hz : 0.0, missed);
+    if(!samples)
+        return 0;
+    if(all) {
+        qsort(pcs, pcCount, sizeof(PC), byPcCount);
+        printf("\n%8s %6s  %-10s %s\n", "samples", "%", "pc", "function+offset");
+        for(i=0; i<pcCount; i++) {
+            printf("%8u %6.1f  0x%08x ", pcs[i].count, 100.0 * pcs[i].count / samples, pcs[i].pc);
+            if(pcs[i].fn)
+                printf("%s+0x%x\n", pcs[i].fn->name, pcs[i].pc - pcs[i].fn->start);
+            else
+                printf("?\n");
+        }
+    }
+
+    qsort(funcs, funcCount, sizeof(FUNC), byCount);     // pcs[].fn are stale from here on
+    printf("\n%8s %6s  %s\n", "samples", "%", "function");
+    for(i=0; i<funcCount && funcs[i].count; i++)
+        printf("%8u %6.1f  %s\n", funcs[i].count, 100.0 * funcs[i].count / samples, funcs[i].name);
+    if(unknown)
+        printf("%8lu %6.1f  ? (outside every function)\n", unknown, 100.0 * unknown / samples);
+    if(missed)
+        printf("%8lu %6.1f  missed (no free slot, raise PROF_SLOTS)\n", missed, 100.0 * missed / samples);
+    return 0;
+}
@@ -0,0 +1,262 @@
+// Host schedulability check for the RTOS task table
+// J Losh
+
+// Reads Project/tasktable.h (the table rtos.c creates its tasks from) at compile time and
+// runs response time analysis for the kernel's fixed priority scheduler, so a task set
+// that can miss a deadline is caught before it is flashed. With -m it first assigns
+// rate monotonic (rm, shorter period = higher priority) or deadline monotonic (dm)
+// priorities to the periodic tasks and prints the table lines to paste back.
+//
+// Model, per periodic task i (times in us):
+//   R = C + B + sum over higher priority j of ceil(R/Tj)*Cj + round robin
+// iterated until it settles or passes the deadline.
+//   C      wcet plus two context switches (-s)
+//   B      longest critical section of a lower priority task on a mutex that task i or a
+//          higher priority task also locks. This holds with pi ON (priority inheritance);
+//          with pi OFF a middle priority task can stretch it without bound
+//   round robin   tasks at the same priority take turns each SysTick (-q). Each of them
+//          can run one quantum per quantum task i needs, or its own releases if fewer
+// A background task (period 0) above task i never lets it run, so i is unschedulable.
+//
+// Build: gcc -O2 -o rta rta.c -lm
+// Use:   ./rta [-m rm|dm] [-s switch us] [-q quantum us]
+//        exit status 0 = schedulable, 1 = a task can miss its deadline, 2 = bad use
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define BACKGROUND_PRIORITY 12                  // where -m moves background tasks above the periodic ones
+#define IDLE_PRIORITY       15
+#define MAX_TASKS           12
+
+typedef struct {
+    const char *fn;
+    const char *name;
+    int priority;
+    int stack;
+    double period, wcet, deadline;              // us
+    const char *mutex;
+    double cs;
+    double blocking, response;
+    int ok;
+} TASK;
+
+#define TASK(fn, name, priority, stack, period, wcet, deadline, mutex, cs) \
+    {#fn, name, priority, stack, (period) * 1000.0, wcet, (deadline) * 1000.0, #mutex, cs, 0, 0, 0},
+static TASK tasks[] = {
+#include "../Project/tasktable.h"
+};
+#undef TASK
+#define TASK_COUNT  ((int)(sizeof(tasks)/sizeof(tasks[0])))
+
+static double switchUs = 0;
+static double quantumUs = 1000;
+
+static int periodic(const TASK *t)
+{
+    return t->period > 0;
+}
+
+static int sharesMutex(const TASK *a, const TASK *b)
+{
+    return strcmp(a->mutex, "none") && !strcmp(a->mutex, b->mutex);
+}
+
+// Longest critical section of a lower priority task on a mutex task i or a task above it locks
+static double blocking(int i)
+{
+    double b = 0;
+    int j, k;
+
+    for(j=0; j<TASK_COUNT; j++) {
+        if(tasks[j].priority <= tasks[i].priority)
+            continue;
+        for(k=0; k<TASK_COUNT; k++)
+            if(tasks[k].priority <= tasks[i].priority && sharesMutex(&tasks[j], &tasks[k])
+               && tasks[j].cs > b)
+                b = tasks[j].cs;
+    }
+    return b;
+}
+
+// Worst case response time of task i, INFINITY if it can starve or the iteration passes
+// the deadline (the set is then unschedulable anyway)
+static double response(int i)
+{
+    TASK *t = &tasks[i];
+    double c = t->wcet + 2*switchUs, r, next, quanta;
+    int j;
+
+    for(j=0; j<TASK_COUNT; j++)
+        if(j != i && tasks[j].priority < t->priority && !periodic(&tasks[j]))
+            return INFINITY;
+
+    quanta = ceil(c / quantumUs);
+    r = c + t->blocking;
+    while(1) {
+        next = c + t->blocking;
+        for(j=0; j<TASK_COUNT; j++) {
+            if(j == i)
+                continue;
+            if(tasks[j].priority < t->priority)
+                next += ceil(r / tasks[j].period) * (tasks[j].wcet + 2*switchUs);
+            else if(tasks[j].priority == t->priority)
+                next += periodic(&tasks[j]) ? fmin(ceil(r / tasks[j].period) * (tasks[j].wcet + 2*switchUs),
+                                                   quanta * quantumUs)
+                                            : quanta * quantumUs;
+        }
+        if(next == r)
+            return r;
+        if(next > t->deadline)
+            return next;
+        r = next;
+    }
+}
+
+static int compareKey(const void *a, const void *b, int dm)
+{
+    const TASK *x = *(const TASK **)a, *y = *(const TASK **)b;
+    double kx = dm ? x->deadline : x->period, ky = dm ? y->deadline : y->period;
+
+    return kx < ky ? -1 : kx > ky;
+}
+
+static int byPeriod(const void *a, const void *b)
+{
+    return compareKey(a, b, 0);
+}
+
+static int byDeadline(const void *a, const void *b)
+{
+    return compareKey(a, b, 1);
+}
+
+// Periodic tasks get 0, 1, ... in key order (equal keys share a level), background tasks
+// go below all of them. Returns 0 if there are more levels than priorities
+static int assign(int dm)
+{
+    TASK *order[MAX_TASKS];
+    int i, n = 0, level = -1, lowest;
+    double last = -1, key;
+
+    for(i=0; i<TASK_COUNT; i++)
+        if(periodic(&tasks[i]))
+            order[n++] = &tasks[i];
+    qsort(order, n, sizeof(order[0]), dm ? byDeadline : byPeriod);
+
+    for(i=0; i<n; i++) {
+        key = dm ? order[i]->deadline : order[i]->period;
+        if(key != last)
+            level++;
+        last = key;
+        order[i]->priority = level;
+    }
+    lowest = level + 1;
+    if(lowest > BACKGROUND_PRIORITY)
+        return 0;
+
+    for(i=0; i<TASK_COUNT; i++)
+        if(!periodic(&tasks[i]) && tasks[i].priority < lowest)
+            tasks[i].priority = BACKGROUND_PRIORITY;
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, method = 0, failed = 0, pi = 0;
+    double u = 0;
+
+    for(i=1; i<argc; i++) {
+        if(!strcmp(argv[i], "-m") && i + 1 < argc) {
+            i++;
+            if(!strcmp(argv[i], "rm"))
+                method = 1;
+            else if(!strcmp(argv[i], "dm"))
+                method = 2;
+            else
+                break;
+        }
+        else if(!strcmp(argv[i], "-s") && i + 1 < argc)
+            switchUs = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-q") && i + 1 < argc)
+            quantumUs = atof(argv[++i]);
+        else
+            break;
+    }
+    if(i < argc || quantumUs <= 0) {
+        fprintf(stderr, "use: %s [-m rm|dm] [-s switch us] [-q quantum us]\n", argv[0]);
+        return 2;
+    }
+    if(TASK_COUNT > MAX_TASKS - 1) {
+        fprintf(stderr, "%d tasks and Idle do not fit in %d tcbs\n", TASK_COUNT, MAX_TASKS);
+        return 1;
+    }
+    for(i=0; i<TASK_COUNT; i++) {
+        if(tasks[i].priority < 0 || tasks[i].priority >= IDLE_PRIORITY) {
+            fprintf(stderr, "%s: priority %d, must be 0 to %d\n", tasks[i].name, tasks[i].priority,
+                    IDLE_PRIORITY - 1);
+            return 1;
+        }
+        if(periodic(&tasks[i]) && (tasks[i].deadline <= 0 || tasks[i].deadline > tasks[i].period)) {
+            fprintf(stderr, "%s: deadline must be 1 to %g ms (the period)\n", tasks[i].name,
+                    tasks[i].period / 1000);
+            return 1;
+        }
+    }
+
+    if(method && !assign(method == 2)) {
+        fprintf(stderr, "more distinct %s than priorities above %d\n", method == 2 ? "deadlines" : "periods",
+                BACKGROUND_PRIORITY);
+        return 1;
+    }
+
+    for(i=0; i<TASK_COUNT; i++) {
+        tasks[i].blocking = blocking(i);
+        if(tasks[i].blocking > 0)
+            pi = 1;
+    }
+    for(i=0; i<TASK_COUNT; i++) {
+        if(!periodic(&tasks[i]))
+            continue;
+        u += (tasks[i].wcet + 2*switchUs) / tasks[i].period;
+        tasks[i].response = response(i);
+        tasks[i].ok = tasks[i].response <= tasks[i].deadline;
+        if(!tasks[i].ok)
+            failed = 1;
+    }
+
+    printf("%-12s %4s %10s %10s %10s %10s %10s  %s\n", "task", "prio", "period us", "wcet us",
+           "deadline", "blocking", "response", "");
+    for(i=0; i<TASK_COUNT; i++) {
+        TASK *t = &tasks[i];
+
+        if(!periodic(t)) {
+            printf("%-12s %4d %10s %10s %10s %10s %10s  background\n", t->name, t->priority,
+                   "-", "-", "-", "-", "-");
+            continue;
+        }
+        printf("%-12s %4d %10.0f %10.0f %10.0f %10.0f ", t->name, t->priority, t->period, t->wcet,
+               t->deadline, t->blocking);
+        if(isinf(t->response))
+            printf("%10s  MISS, starved by a background task above it\n", "-");
+        else
+            printf("%10.0f  %s\n", t->response, t->ok ? "ok" : "MISS");
+    }
+    printf("utilization %.1f %%, %s\n", 100 * u, failed ? "NOT schedulable" : "schedulable");
+    if(pi)
+        printf("blocking assumes pi ON, with pi OFF it is unbounded\n");
+
+    if(method) {
+        printf("\n%s priorities for Project/tasktable.h:\n", method == 2 ? "deadline monotonic" : "rate monotonic");
+        for(i=0; i<TASK_COUNT; i++) {
+            TASK *t = &tasks[i];
+
+            printf("TASK(%s, \"%s\", %d, %d, %.0f, %.0f, %.0f, %s, %.0f)\n", t->fn, t->name, t->priority,
+                   t->stack, t->period / 1000, t->wcet, t->deadline / 1000, t->mutex, t->cs);
+        }
+    }
+    return failed;
+}
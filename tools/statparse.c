@@ -0,0 +1,237 @@
+// Host parser for the RTOS stat telemetry
+// J Losh
+
+// Reads the UART byte stream of "stat CSV [ms]" or "stat BIN [ms]" (a capture file or the
+// serial device, already set to the right baud rate) and writes every summary and task
+// record as one CSV line, in the same columns for both modes, see Project/statrec.h.
+// Binary frames are checked (COBS, checksum, version) and dropped if damaged; shell text,
+// prompts and log frames are skipped, so the output can be fed straight to a dashboard.
+//
+// Build: gcc -O2 -o statparse statparse.c
+// Use:   ./statparse [file] [cpu Hz]      (stdin and 40 MHz by default)
+//        adds the derived %CPU (task ticks / sum of all task ticks) as a last task column
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Project/statrec.h"
+
+#define MAX_FRAME       256
+#define MAX_LINE        256
+#define MAX_TASKS       32
+
+typedef struct {
+    int valid;
+    unsigned index, state, priority;
+    uint32_t pid, ticks, peak, size, heap;
+    char name[STAT_NAME_MAX + 1];
+} TASK;
+
+// Task lines are held until the next summary (or the end) so %CPU can be worked out
+static TASK tasks[MAX_TASKS];
+static uint32_t generation;
+static double hz = 40e6;
+
+// Undo COBS, returns decoded length or -1 if the frame is malformed
+static int cobsDecode(const uint8_t *src, int len, uint8_t *dst)
+{
+    int in = 0, out = 0, i;
+    uint8_t code;
+
+    while(in < len) {
+        code = src[in++];
+        if(code == 0 || in + code - 1 > len)
+            return -1;
+        for(i=1; i<code; i++)
+            dst[out++] = src[in++];
+        if(code != 0xFF && in < len)
+            dst[out++] = 0;
+    }
+    return out;
+}
+
+static uint32_t field(const uint8_t *p, int bytes)
+{
+    uint32_t n = 0;
+
+    while(bytes--)
+        n = n << 8 | p[bytes];
+    return n;
+}
+
+static void flushTasks(void)
+{
+    uint64_t total = 0;
+    int i;
+
+    for(i=0; i<MAX_TASKS; i++)
+        if(tasks[i].valid)
+            total += tasks[i].ticks;
+
+    for(i=0; i<MAX_TASKS; i++) {
+        TASK *t = &tasks[i];
+
+        if(!t->valid)
+            continue;
+        printf("T,%u,%u,0x%x,%s,%u,%u,%u,%u,%u,%u,%.2f\n", generation, t->index, t->pid, t->name,
+               t->state, t->priority, t->ticks, t->peak, t->size, t->heap,
+               total ? 100.0 * t->ticks / total : 0.0);
+        t->valid = 0;
+    }
+    fflush(stdout);
+}
+
+// Timestamps are a 32-bit cycle counter, unwrap them into a 64-bit time line
+static uint64_t unwrap(uint32_t t)
+{
+    static uint64_t last = 0;
+    static int first = 1;
+    uint64_t now = (last & ~0xFFFFFFFFULL) | t;
+
+    if(first) {
+        first = 0;
+        last = now;
+        return now;
+    }
+    if(now + 0x80000000ULL < last)                  // wrapped, summaries are seconds apart at most
+        now += 0x100000000ULL;
+    if(now > last)
+        last = now;
+    return now;
+}
+
+static void summary(uint32_t gen, uint32_t time, unsigned count, unsigned used, unsigned total,
+                    const unsigned *sems, int semCount)
+{
+    int i;
+
+    flushTasks();
+    generation = gen;
+    printf("S,%u,%.6f,%u,%u,%u", gen, unwrap(time) / hz, count, used, total);
+    for(i=0; i<semCount; i++)
+        printf(",%u", sems[i]);
+    printf("\n");
+}
+
+static void task(uint32_t gen, TASK *t)
+{
+    if(gen != generation)                           // summary lost, start a new group
+        flushTasks();
+    generation = gen;
+    if(t->index < MAX_TASKS) {
+        t->valid = 1;
+        tasks[t->index] = *t;
+    }
+}
+
+// Returns 1 if the frame was a stat record
+static int binaryRecord(const uint8_t *frame, int len)
+{
+    uint8_t rec[MAX_FRAME];
+    unsigned sems[16];
+    uint8_t sum = 0;
+    TASK t;
+    int n, i;
+
+    n = cobsDecode(frame, len, rec);
+    if(n < 3 || rec[1] != STAT_VERSION)
+        return 0;
+    for(i=0; i<n; i++)
+        sum += rec[i];
+    if(sum)
+        return 0;
+    n--;                                            // drop the checksum
+
+    if(rec[0] == STAT_SUMMARY) {
+        if(n < STAT_SUMMARY_FIXED || n != STAT_SUMMARY_FIXED + rec[3] || rec[3] > 16)
+            return 0;
+        for(i=0; i<rec[3]; i++)
+            sems[i] = rec[STAT_SUMMARY_FIXED + i];
+        summary(field(rec + 4, 4), field(rec + 8, 4), rec[2], field(rec + 12, 2), field(rec + 14, 2),
+                sems, rec[3]);
+        return 1;
+    }
+    if(rec[0] == STAT_TASK) {
+        if(n < STAT_TASK_FIXED || n > STAT_TASK_FIXED + STAT_NAME_MAX)
+            return 0;
+        t.index = rec[2];
+        t.state = rec[3];
+        t.pid = field(rec + 8, 4);
+        t.ticks = field(rec + 12, 4);
+        t.peak = field(rec + 16, 2);
+        t.size = field(rec + 18, 2);
+        t.heap = field(rec + 20, 2);
+        t.priority = rec[22];
+        memcpy(t.name, rec + STAT_TASK_FIXED, n - STAT_TASK_FIXED);
+        t.name[n - STAT_TASK_FIXED] = 0;
+        task(field(rec + 4, 4), &t);
+        return 1;
+    }
+    return 0;
+}
+
+// CSV lines from "stat CSV", anything else on the line is shell text
+static void textLine(char *line)
+{
+    unsigned sems[16];
+    uint32_t gen, time;
+    unsigned count, used, total;
+    char *p;
+    int n, k;
+    TASK t;
+
+    line[strcspn(line, "\r\n")] = 0;
+
+    if(sscanf(line, "S,%u,%u,%u,%u,%u%n", &gen, &time, &count, &used, &total, &n) == 5) {
+        k = 0;
+        for(p = line + n; *p == ',' && k < 16; k++)
+            sems[k] = strtoul(p + 1, &p, 10);
+        summary(gen, time, count, used, total, sems, k);
+        return;
+    }
+    if(sscanf(line, "T,%u,%u,%x,%15[^,],%u,%u,%u,%u,%u,%u", &gen, &t.index, &t.pid, t.name,
+              &t.state, &t.priority, &t.ticks, &t.peak, &t.size, &t.heap) == 10)
+        task(gen, &t);
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    uint8_t frame[MAX_FRAME];
+    char line[MAX_LINE];
+    int c, len = 0, text = 0;
+
+    if(argc > 1 && strcmp(argv[1], "-") && !(in = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    if(argc > 2)
+        hz = atof(argv[2]);
+
+    printf("# S,generation,time s,tasks,heap used,heap total,sem counts...\n");
+    printf("# T,generation,index,pid,name,state,priority,cpu ticks,stack peak,stack size,heap,%%cpu\n");
+
+    // Bytes are collected both as a frame (up to 0x00) and as a text line (up to \n),
+    // a line that is not a record and a frame that does not check out are both ignored
+    while((c = fgetc(in)) != EOF) {
+        if(c == 0) {
+            if(len)
+                binaryRecord(frame, len);
+            len = text = 0;
+            continue;
+        }
+        if(len < MAX_FRAME)
+            frame[len++] = c;
+        if(c == '\n') {                             // may also be a byte inside a frame
+            line[text] = 0;
+            textLine(line);
+            text = 0;
+        }
+        else if(text < MAX_LINE - 1)
+            line[text++] = c;
+    }
+    flushTasks();
+    return 0;
+}
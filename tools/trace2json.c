@@ -0,0 +1,250 @@
+// Host converter for the RTOS kernel trace
+// J Losh
+
+// Reads the UART byte stream of the shell's trace command (a capture file or the serial
+// device, already set to the right baud rate) and writes Chrome trace event JSON, which
+// chrome://tracing and ui.perfetto.dev open as a timeline. Each task is a thread row
+// showing when it ran; its semaphore/mutex operations and wakeups are instant events on
+// that row. SVCs are slices and ISRs instants on a separate "kernel" row.
+// Record layout is in Project/statrec.h, event ids in Project/tracefmt.h.
+//
+// Build: gcc -O2 -o trace2json trace2json.c
+// Use:   ./trace2json [file] [cpu Hz] > trace.json      (stdin and 40 MHz by default)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Project/statrec.h"
+
+#define TRACE_EVT(id, name) id,
+enum {
+#include "../Project/tracefmt.h"
+    TRACE_EVT_COUNT
+};
+#undef TRACE_EVT
+
+#define TRACE_EVT(id, name) name,
+static const char *eventNames[] = {
+#include "../Project/tracefmt.h"
+};
+#undef TRACE_EVT
+
+#define MAX_FRAME       256
+#define MAX_TASKS       32
+#define KERNEL_TID      100
+#define TRACE_BLOCKED   0x100
+
+static char names[MAX_TASKS][STAT_NAME_MAX + 1];
+static double hz = 40e6;
+static int events = 0;
+static int running = -1;                            // task row with an open slice
+static uint64_t runStart;
+static int svcOpen = 0;
+static uint64_t lastTime;
+
+// Undo COBS, returns decoded length or -1 if the frame is malformed
+static int cobsDecode(const uint8_t *src, int len, uint8_t *dst)
+{
+    int in = 0, out = 0, i;
+    uint8_t code;
+
+    while(in < len) {
+        code = src[in++];
+        if(code == 0 || in + code - 1 > len)
+            return -1;
+        for(i=1; i<code; i++)
+            dst[out++] = src[in++];
+        if(code != 0xFF && in < len)
+            dst[out++] = 0;
+    }
+    return out;
+}
+
+static uint32_t field(const uint8_t *p, int bytes)
+{
+    uint32_t n = 0;
+
+    while(bytes--)
+        n = n << 8 | p[bytes];
+    return n;
+}
+
+// DWT time is a 32-bit cycle counter, unwrap it into a 64-bit time line
+static uint64_t unwrap(uint32_t t)
+{
+    static uint64_t last = 0;
+    static int first = 1;
+    uint64_t now = (last & ~0xFFFFFFFFULL) | t;
+
+    if(first) {
+        first = 0;
+        last = now;
+        return now;
+    }
+    if(now < last)                                  // events are in order, so it wrapped
+        now += 0x100000000ULL;
+    last = now;
+    return now;
+}
+
+// Microseconds from the first event of the capture
+static double us(uint64_t cycles)
+{
+    static int first = 1;
+    static uint64_t origin;
+
+    if(first) {
+        first = 0;
+        origin = cycles;
+    }
+    return (cycles - origin) * 1e6 / hz;
+}
+
+static void emit(const char *fmt, double ts, int tid, const char *name, const char *args)
+{
+    printf("%s{\"ph\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"name\":\"%s\"%s%s}",
+           events++ ? ",\n" : "", fmt, tid, ts, name, args ? ",\"args\":" : "", args ? args : "");
+}
+
+static const char *taskName(int task)
+{
+    static char unknown[16];
+
+    if(task < MAX_TASKS && names[task][0])
+        return names[task];
+    snprintf(unknown, sizeof(unknown), "task %d", task);
+    return unknown;
+}
+
+// The running slice of a task ends where the next switch starts
+static void closeRun(uint64_t t)
+{
+    if(running < 0)
+        return;
+    printf("%s{\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"name\":\"run\"}",
+           events++ ? ",\n" : "", running, us(runStart), (t - runStart) * 1e6 / hz);
+    running = -1;
+}
+
+static void traceEvent(uint32_t time, uint32_t info)
+{
+    uint64_t t = unwrap(time);
+    int type = info & 0xFF, task = (info >> 8) & 0xFF, arg = info >> 16;
+    char name[48], args[48];
+    const char *what = type < TRACE_EVT_COUNT ? eventNames[type] : "unknown";
+
+    lastTime = t;
+
+    switch(type) {
+        case TR_SWITCH:
+            closeRun(t);
+            running = task;
+            runStart = t;
+            snprintf(args, sizeof(args), "{\"priority\":%d}", arg);
+            emit("i", us(t), task, "switch in", args);
+            break;
+        case TR_SVC:
+            if(svcOpen)
+                emit("E", us(t), KERNEL_TID, "", 0);
+            snprintf(name, sizeof(name), "svc %d", arg);
+            snprintf(args, sizeof(args), "{\"task\":\"%s\"}", taskName(task));
+            emit("B", us(t), KERNEL_TID, name, args);
+            svcOpen = 1;
+            break;
+        case TR_SVC_EXIT:
+            if(svcOpen)
+                emit("E", us(t), KERNEL_TID, "", 0);
+            svcOpen = 0;
+            break;
+        case TR_ISR:
+            snprintf(name, sizeof(name), "isr %d", arg);
+            emit("i", us(t), KERNEL_TID, name, 0);
+            break;
+        case TR_WAIT:
+        case TR_LOCK:
+            snprintf(name, sizeof(name), "%s %c%d%s", what, type == TR_WAIT ? 's' : 'm',
+                     arg & 0xFF, arg & TRACE_BLOCKED ? " (blocked)" : "");
+            emit("i", us(t), task, name, 0);
+            break;
+        case TR_POST:
+        case TR_UNLOCK:
+            snprintf(name, sizeof(name), "%s %c%d", what, type == TR_POST ? 's' : 'm', arg);
+            emit("i", us(t), task, name, 0);
+            break;
+        case TR_WAKE:
+            snprintf(name, sizeof(name), "woken (running: %s)", taskName(task));
+            emit("i", us(t), arg, name, 0);
+            break;
+        default:
+            snprintf(name, sizeof(name), "event %d arg %d", type, arg);
+            emit("i", us(t), task, name, 0);
+            break;
+    }
+}
+
+static void frame(const uint8_t *src, int len)
+{
+    uint8_t rec[MAX_FRAME];
+    uint8_t sum = 0;
+    int n, i;
+
+    n = cobsDecode(src, len, rec);
+    if(n < 4 || rec[1] != STAT_VERSION)
+        return;
+    for(i=0; i<n; i++)
+        sum += rec[i];
+    if(sum)
+        return;
+    n--;                                            // drop the checksum
+
+    if(rec[0] == STAT_TASK && n >= STAT_TASK_FIXED && n <= STAT_TASK_FIXED + STAT_NAME_MAX
+       && rec[2] < MAX_TASKS) {
+        memcpy(names[rec[2]], rec + STAT_TASK_FIXED, n - STAT_TASK_FIXED);
+        names[rec[2]][n - STAT_TASK_FIXED] = 0;
+    }
+    else if(rec[0] == STAT_TRACE && n == STAT_TRACE_FIXED + 8*rec[2]) {
+        for(i=0; i<rec[2]; i++)
+            traceEvent(field(rec + STAT_TRACE_FIXED + 8*i, 4), field(rec + STAT_TRACE_FIXED + 8*i + 4, 4));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *in = stdin;
+    uint8_t buf[MAX_FRAME];
+    int c, len = 0, i;
+
+    if(argc > 1 && strcmp(argv[1], "-") && !(in = fopen(argv[1], "rb"))) {
+        perror(argv[1]);
+        return 1;
+    }
+    if(argc > 2)
+        hz = atof(argv[2]);
+
+    printf("{\"traceEvents\":[\n");
+    while((c = fgetc(in)) != EOF) {
+        if(c != 0) {
+            if(len < MAX_FRAME)
+                buf[len++] = c;
+            continue;
+        }
+        if(len)
+            frame(buf, len);
+        len = 0;
+    }
+    closeRun(lastTime);                             // the last slices end with the dump
+    if(svcOpen)
+        emit("E", us(lastTime), KERNEL_TID, "", 0);
+
+    // Row names, written last since the T records may follow older dumps in a capture
+    for(i=0; i<MAX_TASKS; i++)
+        if(names[i][0])
+            printf("%s{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}",
+                   events++ ? ",\n" : "", i, names[i]);
+    printf("%s{\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"kernel\"}}\n",
+           events++ ? ",\n" : "", KERNEL_TID);
+    printf("]}\n");
+    return 0;
+}